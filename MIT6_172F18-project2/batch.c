@@ -0,0 +1,210 @@
+/**
+ * batch.c -- simulate many independent worlds in one process
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+// A scene of a few hundred lines has too little parallelism to keep every
+// worker busy, so a sweep over many such scenes is better run as one process
+// that simulates all of them at once.  Every world is loaded serially, since
+// LineDemo keeps the input file in static state, and then the worlds are
+// simulated in parallel, each with its own quadtree.  A world's results are
+// the same as those of screensaver on its scene.
+
+#include <cilk/cilk.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./collision_world.h"
+#include "./fasttime.h"
+#include "./line_demo.h"
+
+typedef struct {
+  char *path;
+  LineDemo *lineDemo;
+  // Frames simulated by this run, which do not include those before a
+  // checkpoint the world was loaded from.
+  unsigned int frames;
+} World;
+
+// Simulate a world up to its last frame, as lineMain does in screensaver.
+static void run_world(World *world) {
+  LineDemo *lineDemo = world->lineDemo;
+  unsigned int first = lineDemo->count;
+  QuadTree quadTree = build_quadtree(lineDemo->collisionWorld);
+  while (LineDemo_update(lineDemo, &quadTree)) {
+  }
+  delete_quadtree(&quadTree);
+  world->frames = lineDemo->count - first;
+}
+
+// Append every non-empty line of the file at path to the list of scenes.
+static void read_list(const char *path, char ***scenes, size_t *n,
+                      size_t *cap) {
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    fprintf(stderr, "Cannot read the list of scenes %s\n", path);
+    exit(1);
+  }
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t len;
+  while ((len = getline(&line, &size, in)) != -1) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+      line[--len] = '\0';
+    }
+    if (len == 0) {
+      continue;
+    }
+    if (*n == *cap) {
+      *cap = *cap > 0 ? 2 * *cap : 64;
+      *scenes = realloc(*scenes, *cap * sizeof(char *));
+    }
+    (*scenes)[(*n)++] = strdup(line);
+  }
+  free(line);
+  fclose(in);
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [-s] [-b broadphase] [-n copies] [-l file] <numFrames> "
+         "[scene...]\n",
+         name);
+  printf("  -s : simulate the worlds one after another instead of at once\n");
+  printf("  -b : broad phase: brute, quadtree (default), grid, sap,\n"
+         "       morton, bvh or verlet\n");
+  printf("  -n : simulate that many copies of every scene (default 1)\n");
+  printf("  -l : also simulate the scenes listed in file, one per line\n");
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  bool serial = false;
+  BroadPhase broadPhase = BROAD_PHASE_QUADTREE;
+  int copies = 1;
+  char **scenes = NULL;
+  size_t numOfScenes = 0;
+  size_t scenesCap = 0;
+  int optchar;
+  extern char *optarg;
+  extern int optind;
+
+  while ((optchar = getopt(argc, argv, "sb:n:l:")) != -1) {
+    switch (optchar) {
+    case 's':
+      serial = true;
+      break;
+    case 'b':
+      if (!BroadPhase_parse(optarg, &broadPhase)) {
+        printf("Unknown broad phase: %s\n", optarg);
+        exit(-1);
+      }
+      break;
+    case 'n':
+      copies = atoi(optarg);
+      if (copies <= 0) {
+        printf("Number of copies must be positive: %s\n", optarg);
+        exit(-1);
+      }
+      break;
+    case 'l':
+      read_list(optarg, &scenes, &numOfScenes, &scenesCap);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+  }
+  unsigned int numFrames = atoi(argv[optind]);
+  for (int i = optind + 1; i < argc; i++) {
+    if (numOfScenes == scenesCap) {
+      scenesCap = scenesCap > 0 ? 2 * scenesCap : 64;
+      scenes = realloc(scenes, scenesCap * sizeof(char *));
+    }
+    scenes[numOfScenes++] = strdup(argv[i]);
+  }
+  if (numOfScenes == 0) {
+    usage(argv[0]);
+  }
+
+  size_t numOfWorlds = numOfScenes * copies;
+  World *worlds = malloc(numOfWorlds * sizeof(World));
+  if (worlds == NULL) {
+    fprintf(stderr, "Cannot allocate %zu worlds\n", numOfWorlds);
+    exit(1);
+  }
+  LineDemo_setBroadPhase(broadPhase);
+  for (size_t i = 0; i < numOfWorlds; i++) {
+    World *world = &worlds[i];
+    world->path = scenes[i / copies];
+    world->lineDemo = LineDemo_new();
+    LineDemo_setInputFile(world->path);
+    LineDemo_initLine(world->lineDemo);
+    LineDemo_setNumFrames(world->lineDemo, numFrames);
+  }
+  printf("Number of frames = %u\n", numFrames);
+  printf("Number of worlds = %zu\n", numOfWorlds);
+  printf("Broad phase is: %s\n", BroadPhase_name(broadPhase));
+
+  const fasttime_t start_time = gettime();
+  if (serial) {
+    for (size_t i = 0; i < numOfWorlds; i++) {
+      run_world(&worlds[i]);
+    }
+  } else {
+    cilk_for (size_t i = 0; i < numOfWorlds; i++) {
+      run_world(&worlds[i]);
+    }
+  }
+  const fasttime_t end_time = gettime();
+  double elapsed = tdiff(start_time, end_time);
+
+  printf("---- RESULTS ----\n");
+  size_t frames = 0;
+  double lineFrames = 0;
+  for (size_t i = 0; i < numOfWorlds; i++) {
+    LineDemo *lineDemo = worlds[i].lineDemo;
+    printf("%s: %u Line-Wall Collisions, %u Line-Line Collisions, "
+           "velocity hash %016" PRIx64 "\n",
+           worlds[i].path, LineDemo_getNumLineWallCollisions(lineDemo),
+           LineDemo_getNumLineLineCollisions(lineDemo),
+           LineDemo_getVelocityHash(lineDemo));
+    frames += worlds[i].frames;
+    lineFrames += (double)worlds[i].frames * LineDemo_getNumOfLines(lineDemo);
+    LineDemo_delete(lineDemo);
+  }
+  printf("Elapsed execution time: %fs\n", elapsed);
+  printf("%zu frames in all, %.1f frames/s, %.4g line-frames/s\n", frames,
+         frames / elapsed, lineFrames / elapsed);
+  printf("---- END RESULTS ----\n");
+
+  for (size_t i = 0; i < numOfScenes; i++) {
+    free(scenes[i]);
+  }
+  free(scenes);
+  free(worlds);
+  return 0;
+}
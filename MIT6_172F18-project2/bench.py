@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2012 the Massachusetts Institute of Technology
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Headless benchmark of the screensaver over every input scene.
+
+Each scene is simulated --repeat times with "-v" so that the simulator reports
+its phase times.  The median of every timing is kept, along with the lines and
+frames simulated per second.  The collision counts of every run are compared
+with each other and with the golden file, which is keyed by broad phase and
+frame count; any difference, or a scene with no counts in the golden file,
+makes the script exit with a non-zero status.
+"""
+
+import argparse
+import csv
+import glob
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+
+PHASES = ('broad', 'narrow', 'sort', 'solve', 'update')
+
+RESULT_PATTERNS = {
+    'lines': re.compile(r'Number of lines = (\d+)'),
+    'elapsed': re.compile(r'Elapsed execution time: ([0-9.]+)s'),
+    'wall': re.compile(r'(\d+) Line-Wall Collisions'),
+    'line': re.compile(r'(\d+) Line-Line Collisions'),
+    'phases': re.compile(r'Phase times: ' +
+                         ', '.join(r'%s ([0-9.]+)s' % p for p in PHASES)),
+    'hash': re.compile(r'Velocity hash: ([0-9a-f]+)'),
+}
+
+
+def run_scene(args, scene):
+  """Run one scene once and return the parsed results."""
+  command = [args.binary, '-v', '-b', args.broadphase, str(args.frames),
+             scene]
+  output = subprocess.run(command, check=True, stdout=subprocess.PIPE,
+                          universal_newlines=True).stdout
+  matches = {}
+  for key, pattern in RESULT_PATTERNS.items():
+    match = pattern.search(output)
+    if match is None:
+      sys.exit('%s: no "%s" in the output of %s' %
+               (scene, key, ' '.join(command)))
+    matches[key] = match
+  return {
+      'lines': int(matches['lines'].group(1)),
+      'elapsed': float(matches['elapsed'].group(1)),
+      'wall': int(matches['wall'].group(1)),
+      'line': int(matches['line'].group(1)),
+      'phases': [float(t) for t in matches['phases'].groups()],
+      'hash': matches['hash'].group(1),
+  }
+
+
+def bench_scene(args, scene):
+  """Run one scene --repeat times and summarize the runs."""
+  runs = [run_scene(args, scene) for _ in range(args.repeat)]
+  name = os.path.splitext(os.path.basename(scene))[0]
+  outcomes = {(r['wall'], r['line'], r['hash']) for r in runs}
+  if len(outcomes) != 1:
+    print('%s: repeated runs disagree: %s' % (name, sorted(outcomes)),
+          file=sys.stderr)
+  elapsed = statistics.median(r['elapsed'] for r in runs)
+  result = {
+      'scene': name,
+      # Read from the simulator, which accepts text and binary scenes and
+      # checkpoints alike.
+      'lines': runs[0]['lines'],
+      'wall': runs[0]['wall'],
+      'line': runs[0]['line'],
+      'deterministic': len(outcomes) == 1,
+      'elapsed': elapsed,
+  }
+  for i, phase in enumerate(PHASES):
+    result[phase] = statistics.median(r['phases'][i] for r in runs)
+  result['frames_per_s'] = args.frames / elapsed if elapsed else 0.0
+  result['lines_per_s'] = result['lines'] * result['frames_per_s']
+  return result
+
+
+def check_golden(args, results):
+  """Compare the counts with the golden file, or record them there."""
+  key = '%s/%d' % (args.broadphase, args.frames)
+  golden = {}
+  if os.path.exists(args.golden):
+    with open(args.golden) as f:
+      golden = json.load(f)
+  counts = {r['scene']: [r['wall'], r['line']] for r in results}
+  if args.update_golden:
+    golden[key] = counts
+    with open(args.golden, 'w') as f:
+      json.dump(golden, f, indent=2, sort_keys=True)
+      f.write('\n')
+    return True
+  if key not in golden:
+    print('No golden counts for %s in %s; run with --update-golden to record '
+          'them' % (key, args.golden), file=sys.stderr)
+    return False
+  ok = True
+  for scene, count in sorted(counts.items()):
+    expected = golden[key].get(scene)
+    if expected is None:
+      print('%s: no golden counts for %s in %s; run with --update-golden to '
+            'record them' % (scene, key, args.golden), file=sys.stderr)
+      ok = False
+    elif expected != count:
+      print('%s: expected %d wall and %d line collisions, got %d and %d' %
+            (scene, expected[0], expected[1], count[0], count[1]),
+            file=sys.stderr)
+      ok = False
+  return ok
+
+
+def print_table(results):
+  print('%-12s %8s %8s %8s %8s %8s %8s %8s %8s %10s %12s' %
+        (('scene', 'elapsed') + PHASES + ('wall', 'line', 'frames/s',
+                                          'lines/s')))
+  for r in results:
+    print('%-12s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8d %8d %10.1f %12.4g' %
+          ((r['scene'], r['elapsed']) + tuple(r[p] for p in PHASES) +
+           (r['wall'], r['line'], r['frames_per_s'], r['lines_per_s'])))
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+  parser.add_argument('--binary', default='./screensaver.double',
+                      help='text-only simulator to run')
+  parser.add_argument('--frames', type=int, default=300)
+  parser.add_argument('--repeat', type=int, default=3)
+  parser.add_argument('--broadphase', default='quadtree')
+  parser.add_argument('--scenes', default='input/*.in',
+                      help='glob of the scenes to simulate')
+  parser.add_argument('--golden', default='bench_golden.json')
+  parser.add_argument('--update-golden', action='store_true',
+                      help='record the counts instead of checking them')
+  parser.add_argument('--json', help='also write the results to this file')
+  parser.add_argument('--csv', help='also write the results to this file')
+  args = parser.parse_args()
+  if args.repeat < 1:
+    parser.error('--repeat must be positive')
+
+  # An empty glob must not pass the golden check by checking nothing.
+  scenes = sorted(glob.glob(args.scenes))
+  if not scenes:
+    sys.exit('No scene matches %s' % args.scenes)
+  results = [bench_scene(args, scene) for scene in scenes]
+  print_table(results)
+
+  if args.json:
+    with open(args.json, 'w') as f:
+      json.dump({'binary': args.binary, 'frames': args.frames,
+                 'repeat': args.repeat, 'broadphase': args.broadphase,
+                 'results': results}, f, indent=2)
+      f.write('\n')
+  if args.csv:
+    with open(args.csv, 'w', newline='') as f:
+      writer = csv.DictWriter(f, fieldnames=list(results[0].keys()))
+      writer.writeheader()
+      writer.writerows(results)
+
+  ok = check_golden(args, results)
+  ok = all(r['deterministic'] for r in results) and ok
+  return 0 if ok else 1
+
+
+if __name__ == '__main__':
+  sys.exit(main())
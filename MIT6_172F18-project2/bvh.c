@@ -0,0 +1,224 @@
+/**
+ * bvh.c -- bounding volume hierarchy over the lines' swept bounding boxes
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./bvh.h"
+
+#include <assert.h>
+#include <cilk/cilk.h>
+#include <stdlib.h>
+
+static inline void set_box(BvhBox *box, Line *line, double t) {
+  Line_sweptBounds(line, t, &box->xlo, &box->ylo, &box->xhi, &box->yhi);
+}
+
+static inline void grow_box(BvhBox *box, const BvhBox *other) {
+  box->xlo = other->xlo < box->xlo ? other->xlo : box->xlo;
+  box->xhi = other->xhi > box->xhi ? other->xhi : box->xhi;
+  box->ylo = other->ylo < box->ylo ? other->ylo : box->ylo;
+  box->yhi = other->yhi > box->yhi ? other->yhi : box->yhi;
+}
+
+static inline double half_perimeter(const BvhBox *box) {
+  return (box->xhi - box->xlo) + (box->yhi - box->ylo);
+}
+
+// Twice the center of a box along an axis, 0 for x and 1 for y.
+static inline double center(const BvhBox *box, int axis) {
+  return axis == 0 ? box->xlo + box->xhi : box->ylo + box->yhi;
+}
+
+static inline void swap_lines(Bvh *bvh, unsigned int i, unsigned int j) {
+  Line *line = bvh->lines[i];
+  bvh->lines[i] = bvh->lines[j];
+  bvh->lines[j] = line;
+  BvhBox box = bvh->boxes[i];
+  bvh->boxes[i] = bvh->boxes[j];
+  bvh->boxes[j] = box;
+}
+
+// Reorder the lines from lo up to hi so that the one at k has the k-th
+// smallest center along axis, none before it has a larger center and none
+// after it a smaller one.  Quickselect with a three-way partition, so lines
+// with equal centers cannot stall it.
+static void select_median(Bvh *bvh, unsigned int lo, unsigned int hi,
+                          unsigned int k, int axis) {
+  while (hi - lo > 1) {
+    double a = center(&bvh->boxes[lo], axis);
+    double b = center(&bvh->boxes[lo + (hi - lo) / 2], axis);
+    double c = center(&bvh->boxes[hi - 1], axis);
+    double pivot = a < b ? (b < c ? b : (a < c ? c : a))
+                         : (a < c ? a : (b < c ? c : b));
+    unsigned int lt = lo;
+    unsigned int i = lo;
+    unsigned int gt = hi;
+    while (i < gt) {
+      double x = center(&bvh->boxes[i], axis);
+      if (x < pivot) {
+        swap_lines(bvh, lt++, i++);
+      } else if (x > pivot) {
+        swap_lines(bvh, i, --gt);
+      } else {
+        i++;
+      }
+    }
+    if (k < lt) {
+      hi = lt;
+    } else if (k >= gt) {
+      lo = gt;
+    } else {
+      return;
+    }
+  }
+}
+
+// Build the subtree of node index over count lines starting at first.
+static void build_node(Bvh *bvh, unsigned int index, unsigned int first,
+                       unsigned int count) {
+  BvhNode *node = &bvh->nodes[index];
+  node->first = first;
+  node->count = count;
+  node->left = 0;
+  node->right = 0;
+  if (count <= BVH_LEAF_SIZE) {
+    return;
+  }
+
+  // Split at the median center along the axis where the centers spread
+  // furthest.
+  double cxlo = INFINITY, cxhi = -INFINITY, cylo = INFINITY, cyhi = -INFINITY;
+  for (unsigned int i = first; i < first + count; i++) {
+    double cx = center(&bvh->boxes[i], 0);
+    double cy = center(&bvh->boxes[i], 1);
+    cxlo = cx < cxlo ? cx : cxlo;
+    cxhi = cx > cxhi ? cx : cxhi;
+    cylo = cy < cylo ? cy : cylo;
+    cyhi = cy > cyhi ? cy : cyhi;
+  }
+  int axis = cxhi - cxlo < cyhi - cylo;
+  unsigned int half = count / 2;
+  select_median(bvh, first, first + count, first + half, axis);
+
+  // Children are allocated in pairs, so subtrees can be built in parallel.
+  unsigned int left = atomic_fetch_add(&bvh->numOfNodes, 2);
+  assert(left + 2 <= bvh->nodeCap);
+  node->left = left;
+  node->right = left + 1;
+  if (count > BVH_SPAWN_CUTOFF) {
+    cilk_scope {
+      cilk_spawn build_node(bvh, left, first, half);
+      build_node(bvh, left + 1, first + half, count - half);
+    }
+  } else {
+    build_node(bvh, left, first, half);
+    build_node(bvh, left + 1, first + half, count - half);
+  }
+}
+
+// Recompute the boxes of the subtree of node index from the lines' boxes.
+// Returns the sum of the half perimeters of the subtree's internal nodes.
+static double refit_node(Bvh *bvh, unsigned int index) {
+  BvhNode *node = &bvh->nodes[index];
+  if (node->left == 0) {
+    node->box = bvh->boxes[node->first];
+    for (unsigned int i = node->first + 1; i < node->first + node->count;
+         i++) {
+      grow_box(&node->box, &bvh->boxes[i]);
+    }
+    return 0;
+  }
+
+  double leftCost, rightCost;
+  if (node->count > BVH_SPAWN_CUTOFF) {
+    cilk_scope {
+      leftCost = cilk_spawn refit_node(bvh, node->left);
+      rightCost = refit_node(bvh, node->right);
+    }
+  } else {
+    leftCost = refit_node(bvh, node->left);
+    rightCost = refit_node(bvh, node->right);
+  }
+  node->box = bvh->nodes[node->left].box;
+  grow_box(&node->box, &bvh->nodes[node->right].box);
+  return leftCost + rightCost + half_perimeter(&node->box);
+}
+
+// Build the tree from scratch over the current boxes.
+static void rebuild(Bvh *bvh) {
+  atomic_store(&bvh->numOfNodes, 1);
+  build_node(bvh, 0, 0, bvh->numOfLines);
+  bvh->cost = refit_node(bvh, 0);
+  bvh->builtCost = bvh->cost;
+}
+
+Bvh *Bvh_new(CollisionWorld *collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  Bvh *bvh = malloc(sizeof(Bvh));
+  assert(bvh);
+  bvh->numOfLines = n;
+  // A tree over n lines has fewer than 2n nodes.
+  bvh->nodeCap = 2 * (n > 0 ? n : 1);
+  bvh->nodes = malloc(bvh->nodeCap * sizeof(BvhNode));
+  bvh->lines = malloc((n > 0 ? n : 1) * sizeof(Line *));
+  bvh->boxes = malloc((n > 0 ? n : 1) * sizeof(BvhBox));
+  assert(bvh->nodes && bvh->lines && bvh->boxes);
+  atomic_init(&bvh->numOfNodes, 0);
+  bvh->cost = 0;
+  bvh->builtCost = 0;
+  bvh->rebuilds = 0;
+  if (n == 0) {
+    return bvh;
+  }
+
+  double t = collisionWorld->timeStep;
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    bvh->lines[i] = collisionWorld->lines[i];
+    set_box(&bvh->boxes[i], bvh->lines[i], t);
+  }
+  rebuild(bvh);
+  return bvh;
+}
+
+void Bvh_delete(Bvh *bvh) {
+  if (bvh == NULL) {
+    return;
+  }
+  free(bvh->nodes);
+  free(bvh->lines);
+  free(bvh->boxes);
+  free(bvh);
+}
+
+void Bvh_update(Bvh *bvh, CollisionWorld *collisionWorld) {
+  if (bvh->numOfLines == 0) {
+    return;
+  }
+  double t = collisionWorld->timeStep;
+  cilk_for (unsigned int i = 0; i < bvh->numOfLines; i++) {
+    set_box(&bvh->boxes[i], bvh->lines[i], t);
+  }
+  bvh->cost = refit_node(bvh, 0);
+  if (bvh->cost > BVH_REBUILD_RATIO * bvh->builtCost) {
+    rebuild(bvh);
+    bvh->rebuilds++;
+  }
+}
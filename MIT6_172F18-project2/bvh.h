@@ -0,0 +1,93 @@
+/**
+ * bvh.h -- bounding volume hierarchy over the lines' swept bounding boxes
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <stdatomic.h>
+
+#include "./collision_world.h"
+#include "./line.h"
+
+// Most lines held by a leaf.
+#define BVH_LEAF_SIZE 8
+
+// Subtrees of fewer lines are built, refit and traversed serially.
+#define BVH_SPAWN_CUTOFF 512
+
+// The tree is rebuilt once refitting has grown its cost to this multiple of
+// the cost it had when built.
+#define BVH_REBUILD_RATIO 1.2
+
+typedef struct {
+  double xlo;
+  double xhi;
+  double ylo;
+  double yhi;
+} BvhBox;
+
+// A node covers the lines from lines[first] up to, but not including,
+// lines[first + count].  Internal nodes have two children; leaves have
+// left == 0, since the root is never anyone's child.
+typedef struct {
+  BvhBox box;
+  unsigned int first;
+  unsigned int count;
+  unsigned int left;
+  unsigned int right;
+} BvhNode;
+
+// A binary tree of the lines' swept bounding boxes, built by median splits.
+// Each frame the boxes are refit bottom-up while the topology is kept, and the
+// tree is only rebuilt once the refit boxes have grown too loose.
+struct Bvh {
+  BvhNode *nodes;
+  atomic_uint numOfNodes;
+  unsigned int nodeCap;
+  // The lines in tree order, and each one's swept bounding box.
+  Line **lines;
+  BvhBox *boxes;
+  unsigned int numOfLines;
+  // Sum of the half perimeters of the internal nodes, now and right after
+  // the last build.
+  double cost;
+  double builtCost;
+  size_t rebuilds;
+};
+typedef struct Bvh Bvh;
+
+// Build a tree over the lines currently in the world.
+Bvh *Bvh_new(CollisionWorld *collisionWorld);
+
+void Bvh_delete(Bvh *bvh);
+
+// Refit the tree to the lines' swept boxes for the coming time step, and
+// rebuild it if it has degraded too far.
+void Bvh_update(Bvh *bvh, CollisionWorld *collisionWorld);
+
+static inline bool BvhBox_overlap(const BvhBox *a, const BvhBox *b) {
+  return a->xlo <= b->xhi && b->xlo <= a->xhi && a->ylo <= b->yhi &&
+         b->ylo <= a->yhi;
+}
+
+#endif  // BVH_H_
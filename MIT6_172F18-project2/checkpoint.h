@@ -0,0 +1,71 @@
+/**
+ * checkpoint.h -- binary snapshots of a running simulation
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdint.h>
+
+// A checkpoint holds everything needed to carry on a simulation exactly where
+// it stopped: the number of frames simulated, the collision counters and the
+// state of every line in box coordinates, in line ID order.  Coordinates are
+// stored as doubles whatever the precision of the build, so a checkpoint
+// taken by a double precision build restores bit for bit.  Broad phase
+// structures are not saved; they are rebuilt from the lines.  The quadtree
+// finds different candidates depending on how it has evolved, so each line's
+// quadtree node is saved too, and the tree is rebuilt in the same shape.
+//
+// A checkpoint is given to screensaver in place of a scene.
+
+#define CHECKPOINT_MAGIC "LCKP"
+#define CHECKPOINT_VERSION 1
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t numOfLines;
+  uint32_t frame;
+  uint32_t numLineWallCollisions;
+  uint32_t numLineLineCollisions;
+} CheckpointHeader;
+
+typedef struct {
+  double p1x, p1y;
+  double p2x, p2y;
+  double p3x, p3y;
+  double p4x, p4y;
+  double vx, vy;
+  double length;
+  // The line's quadtree node, as coded by quadtree_placement, or 0.
+  uint64_t quadtreeNode;
+  uint32_t color;
+  uint32_t reserved;
+} CheckpointRecord;
+
+_Static_assert(sizeof(CheckpointHeader) == 24,
+               "CheckpointHeader must be packed");
+_Static_assert(sizeof(CheckpointRecord) == 104,
+               "CheckpointRecord must be packed");
+
+#endif  // CHECKPOINT_H_
@@ -3,8 +3,12 @@ CXXFLAGS += -fsanitize=cilk
 LDFLAGS += -fsanitize=cilk
 endif
 
+# Cilkscale reports the work and span of the program when it exits, to
+# standard output or to the file named by CILKSCALE_OUT.
+CILKSCALE_FLAGS = -fcilktool=cilkscale -DCILKSCALE
+
 ifeq ($(CILKSCALE),1)
-CXXFLAGS += -mllvm -instrument-cilk -DCILKSCALE
-LDFLAGS += -lcilkscale
+CXXFLAGS += $(CILKSCALE_FLAGS)
+LDFLAGS += $(CILKSCALE_FLAGS)
 endif
 
@@ -21,8 +21,18 @@
  * SOFTWARE.
  **/
 
-#define QUADTREE
-#define R_PARAM 3
+#define SOA
+// Number of candidates handed to intersect_batch() at a time.
+#define INTERSECT_BATCH 32
+// Solve each frame's events in parallel rounds of events with no line in
+// common.  Frames with fewer events than the cutoff are solved serially.
+#define PARALLEL_SOLVE
+// Must be at least 2, since the rounds are ordered into the sort's scratch
+// buffer and the sort does not grow it for a single event.
+#define PARALLEL_SOLVE_CUTOFF 64
+// Skip the intersection test of candidate pairs whose swept bounding boxes do
+// not overlap.
+#define AABB_PREFILTER
 #include "./collision_world.h"
 #include <assert.h>
 #include <cilk/cilk.h>
@@ -32,6 +42,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "./bvh.h"
+#include "./fasttime.h"
+#include "./grid.h"
+#include "./linear_quadtree.h"
+#include "./pair_cache.h"
+#include "./sweep_and_prune.h"
 #include "./intersection_detection.h"
 #include "./intersection_event_list.h"
 #include "./line.h"
@@ -42,9 +58,191 @@ void plus(void *left, void *right) {
   *(unsigned int *)left += *(unsigned int *)right;
 }
 
-unsigned int cilk_reducer(zero, plus) numLineWallCollisions;
+// The events and counters of a frame belong to the world, so that several
+// worlds can be simulated at once.  A reducer cannot be a member of a world
+// allocated on the heap, so each worker appends to its own event list and
+// counts into its own counters instead.  check_lines spawns nothing, so the
+// strand running it stays on one worker and no two strands ever write the
+// same list at the same time.  The lists keep their capacity across frames,
+// so in steady state appending does not allocate.
+static inline unsigned int worker(void) {
+  return __cilkrts_get_worker_number();
+}
+
+// Move every worker's events into the first worker's list and return it.
+static IntersectionEventList *gather_events(CollisionWorld *collisionWorld) {
+  IntersectionEventList *events = &collisionWorld->workerEvents[0];
+  for (unsigned int w = 1; w < collisionWorld->numOfWorkers; w++) {
+    IntersectionEventList_concat(events, &collisionWorld->workerEvents[w]);
+  }
+  return events;
+}
+
+#ifdef COLLISION_STATS
+void pair_counts_zero(void *view) { memset(view, 0, sizeof(PairCounts)); }
+
+void pair_counts_add(void *left, void *right) {
+  PairCounts *l = left;
+  PairCounts *r = right;
+  l->candidatePairs += r->candidatePairs;
+  for (int t = 0; t <= ALREADY_INTERSECTED; t++) {
+    l->intersections[t] += r->intersections[t];
+  }
+  l->rejectedPairs += r->rejectedPairs;
+}
+
+// Add the shape of the subtree rooted at n, whose root is at the given depth,
+// to the frame's counters.
+static void count_quadtree(const Node *n, size_t depth,
+                           CollisionStats *frame) {
+  frame->quadtreeNodes++;
+  if (depth > frame->quadtreeDepth) {
+    frame->quadtreeDepth = depth;
+  }
+  if (n->children == NULL) {
+    frame->quadtreeLeaves++;
+    return;
+  }
+  for (int i = 0; i < 4; i++) {
+    count_quadtree(&n->children[i], depth + 1, frame);
+  }
+}
+
+// Fold the counters of the frame just simulated into the world's totals, and
+// dump them if requested.
+static void record_frame_stats(CollisionWorld *collisionWorld, QuadTree *q) {
+  CollisionStats frame = {0};
+  frame.frames = 1;
+  PairCounts counts;
+  pair_counts_zero(&counts);
+  for (unsigned int w = 0; w < collisionWorld->numOfWorkers; w++) {
+    pair_counts_add(&counts, &collisionWorld->workerPairCounts[w]);
+    pair_counts_zero(&collisionWorld->workerPairCounts[w]);
+  }
+  frame.candidatePairs = counts.candidatePairs;
+  memcpy(frame.intersections, counts.intersections,
+         sizeof(frame.intersections));
+  frame.rejectedPairs = counts.rejectedPairs;
+  frame.events = collisionWorld->frameEvents;
+  collisionWorld->frameEvents = 0;
+  if (collisionWorld->broadPhase == BROAD_PHASE_QUADTREE && q->root != NULL) {
+    count_quadtree(q->root, 0, &frame);
+    frame.rootLines = q->root->lines.len;
+  }
+
+  CollisionStats *stats = &collisionWorld->stats;
+  if (collisionWorld->statsDump != NULL) {
+    if (stats->frames == 0) {
+      fprintf(collisionWorld->statsDump,
+              "frame,candidates,no_intersection,l1_with_l2,l2_with_l1,"
+              "already_intersected,events,nodes,leaves,depth,root_lines,"
+              "rejected\n");
+    }
+    fprintf(collisionWorld->statsDump,
+            "%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu\n",
+            stats->frames, frame.candidatePairs,
+            frame.intersections[NO_INTERSECTION],
+            frame.intersections[L1_WITH_L2], frame.intersections[L2_WITH_L1],
+            frame.intersections[ALREADY_INTERSECTED], frame.events,
+            frame.quadtreeNodes, frame.quadtreeLeaves, frame.quadtreeDepth,
+            frame.rootLines, frame.rejectedPairs);
+  }
 
-unsigned int cilk_reducer(zero, plus) numLineLineCollisions;
+  stats->frames++;
+  stats->candidatePairs += frame.candidatePairs;
+  for (int t = 0; t <= ALREADY_INTERSECTED; t++) {
+    stats->intersections[t] += frame.intersections[t];
+  }
+  stats->rejectedPairs += frame.rejectedPairs;
+  stats->events += frame.events;
+  if (frame.events > stats->maxEvents) {
+    stats->maxEvents = frame.events;
+  }
+  stats->quadtreeNodes += frame.quadtreeNodes;
+  stats->quadtreeLeaves += frame.quadtreeLeaves;
+  stats->quadtreeDepth += frame.quadtreeDepth;
+  if (frame.quadtreeDepth > stats->maxQuadtreeDepth) {
+    stats->maxQuadtreeDepth = frame.quadtreeDepth;
+  }
+  stats->rootLines += frame.rootLines;
+}
+
+void CollisionWorld_printStats(CollisionWorld *collisionWorld, FILE *out) {
+  CollisionStats *stats = &collisionWorld->stats;
+  if (stats->frames == 0) {
+    return;
+  }
+  double frames = stats->frames;
+  size_t hits = stats->candidatePairs - stats->intersections[NO_INTERSECTION];
+  fprintf(out, "Candidate pairs: %zu (%.1f per frame, %.3f%% intersect)\n",
+          stats->candidatePairs, stats->candidatePairs / frames,
+          stats->candidatePairs ? 100.0 * hits / stats->candidatePairs : 0.0);
+  fprintf(out, "Rejected by bounding boxes: %zu (%.1f%% of candidates)\n",
+          stats->rejectedPairs,
+          stats->candidatePairs
+              ? 100.0 * stats->rejectedPairs / stats->candidatePairs
+              : 0.0);
+  double narrowPhase = collisionWorld->phaseTimes.narrowPhase;
+  fprintf(out, "Narrow phase: %.4g pairs/s\n",
+          narrowPhase > 0 ? stats->candidatePairs / narrowPhase : 0.0);
+  fprintf(out,
+          "Intersections: %zu L1_WITH_L2, %zu L2_WITH_L1, "
+          "%zu ALREADY_INTERSECTED\n",
+          stats->intersections[L1_WITH_L2], stats->intersections[L2_WITH_L1],
+          stats->intersections[ALREADY_INTERSECTED]);
+  fprintf(out, "Events per frame: %.2f (max %zu)\n", stats->events / frames,
+          stats->maxEvents);
+  if (collisionWorld->broadPhase == BROAD_PHASE_QUADTREE) {
+    fprintf(out,
+            "Quadtree per frame: %.1f nodes, %.1f leaves, depth %.2f "
+            "(max %zu), %.1f lines at the root\n",
+            stats->quadtreeNodes / frames, stats->quadtreeLeaves / frames,
+            stats->quadtreeDepth / frames, stats->maxQuadtreeDepth,
+            stats->rootLines / frames);
+  }
+}
+#endif
+
+static const char *broadPhaseNames[] = {
+    [BROAD_PHASE_BRUTE] = "brute",
+    [BROAD_PHASE_QUADTREE] = "quadtree",
+    [BROAD_PHASE_GRID] = "grid",
+    [BROAD_PHASE_SAP] = "sap",
+    [BROAD_PHASE_MORTON] = "morton",
+    [BROAD_PHASE_BVH] = "bvh",
+    [BROAD_PHASE_VERLET] = "verlet",
+};
+
+bool BroadPhase_parse(const char *name, BroadPhase *broadPhase) {
+  for (int i = 0; i < sizeof(broadPhaseNames) / sizeof(*broadPhaseNames);
+       i++) {
+    if (strcmp(name, broadPhaseNames[i]) == 0) {
+      *broadPhase = (BroadPhase)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *BroadPhase_name(BroadPhase broadPhase) {
+  return broadPhaseNames[broadPhase];
+}
+
+// Add the time since *mark to *phase and restart the clock.
+static inline void phase_lap(double *phase, fasttime_t *mark) {
+  fasttime_t now = gettime();
+  *phase += tdiff(*mark, now);
+  *mark = now;
+}
+
+// SoA arrays are 32-byte aligned so the kernels below can use full AVX
+// vectors without peeling.
+static inline vec_dimension *soa_alloc(const unsigned int capacity) {
+  size_t bytes = (capacity * sizeof(vec_dimension) + 31) & ~(size_t)31;
+  vec_dimension *a = aligned_alloc(32, bytes);
+  assert(a);
+  return a;
+}
 
 CollisionWorld *CollisionWorld_new(const unsigned int capacity) {
   assert(capacity > 0);
@@ -57,14 +255,108 @@ CollisionWorld *CollisionWorld_new(const unsigned int capacity) {
   collisionWorld->timeStep = 0.5;
   collisionWorld->lines = malloc(capacity * sizeof(Line *));
   collisionWorld->numOfLines = 0;
+
+  LineSoA *soa = &collisionWorld->soa;
+  soa->p1x = soa_alloc(capacity);
+  soa->p1y = soa_alloc(capacity);
+  soa->p2x = soa_alloc(capacity);
+  soa->p2y = soa_alloc(capacity);
+  soa->p3x = soa_alloc(capacity);
+  soa->p3y = soa_alloc(capacity);
+  soa->p4x = soa_alloc(capacity);
+  soa->p4y = soa_alloc(capacity);
+  soa->vx = soa_alloc(capacity);
+  soa->vy = soa_alloc(capacity);
+
+  LineBounds *bounds = &collisionWorld->bounds;
+  bounds->xlo = malloc(capacity * sizeof(double));
+  bounds->xhi = malloc(capacity * sizeof(double));
+  bounds->ylo = malloc(capacity * sizeof(double));
+  bounds->yhi = malloc(capacity * sizeof(double));
+  assert(bounds->xlo && bounds->xhi && bounds->ylo && bounds->yhi);
+
+  collisionWorld->numOfWorkers = __cilkrts_get_nworkers();
+  collisionWorld->workerEvents =
+      malloc(collisionWorld->numOfWorkers * sizeof(IntersectionEventList));
+  assert(collisionWorld->workerEvents);
+  for (unsigned int w = 0; w < collisionWorld->numOfWorkers; w++) {
+    collisionWorld->workerEvents[w] = IntersectionEventList_make();
+  }
+  collisionWorld->numLineWallCollisions = 0;
+  collisionWorld->numLineLineCollisions = 0;
+  collisionWorld->sortScratch = IntersectionEventList_make();
+  collisionWorld->schedule.lastRound = calloc(capacity, sizeof(unsigned int));
+  assert(collisionWorld->schedule.lastRound);
+  collisionWorld->schedule.eventRound = NULL;
+  collisionWorld->schedule.eventRoundCap = 0;
+  collisionWorld->schedule.roundStart = NULL;
+  collisionWorld->schedule.roundStartCap = 0;
+  collisionWorld->lineStorage = NULL;
+  collisionWorld->quadtreePlacement = NULL;
+  collisionWorld->broadPhase = BROAD_PHASE_QUADTREE;
+  collisionWorld->grid = NULL;
+  collisionWorld->sap = NULL;
+  collisionWorld->linearQuadTree = NULL;
+  collisionWorld->bvh = NULL;
+  collisionWorld->pairCache = NULL;
+  collisionWorld->grainSize = DEFAULT_GRAIN_SIZE;
+  collisionWorld->spawnCutoff = DEFAULT_SPAWN_CUTOFF;
+  collisionWorld->phaseTimes = (PhaseTimes){0};
+  collisionWorld->eventLog = NULL;
+#ifdef COLLISION_STATS
+  collisionWorld->stats = (CollisionStats){0};
+  collisionWorld->statsDump = NULL;
+  collisionWorld->workerPairCounts =
+      calloc(collisionWorld->numOfWorkers, sizeof(PairCounts));
+  assert(collisionWorld->workerPairCounts);
+  collisionWorld->frameEvents = 0;
+#endif
   return collisionWorld;
 }
 
 void CollisionWorld_delete(CollisionWorld *collisionWorld) {
-  for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    free(collisionWorld->lines[i]);
+  free(collisionWorld->quadtreePlacement);
+  if (collisionWorld->lineStorage != NULL) {
+    free(collisionWorld->lineStorage);
+  } else {
+    for (int i = 0; i < collisionWorld->numOfLines; i++) {
+      free(collisionWorld->lines[i]);
+    }
   }
   free(collisionWorld->lines);
+
+  LineSoA *soa = &collisionWorld->soa;
+  free(soa->p1x);
+  free(soa->p1y);
+  free(soa->p2x);
+  free(soa->p2y);
+  free(soa->p3x);
+  free(soa->p3y);
+  free(soa->p4x);
+  free(soa->p4y);
+  free(soa->vx);
+  free(soa->vy);
+  LineBounds *bounds = &collisionWorld->bounds;
+  free(bounds->xlo);
+  free(bounds->xhi);
+  free(bounds->ylo);
+  free(bounds->yhi);
+  for (unsigned int w = 0; w < collisionWorld->numOfWorkers; w++) {
+    IntersectionEventList_free(&collisionWorld->workerEvents[w]);
+  }
+  free(collisionWorld->workerEvents);
+#ifdef COLLISION_STATS
+  free(collisionWorld->workerPairCounts);
+#endif
+  IntersectionEventList_free(&collisionWorld->sortScratch);
+  free(collisionWorld->schedule.lastRound);
+  free(collisionWorld->schedule.eventRound);
+  free(collisionWorld->schedule.roundStart);
+  Grid_delete(collisionWorld->grid);
+  SweepAndPrune_delete(collisionWorld->sap);
+  LinearQuadTree_delete(collisionWorld->linearQuadTree);
+  Bvh_delete(collisionWorld->bvh);
+  PairCache_delete(collisionWorld->pairCache);
   free(collisionWorld);
 }
 
@@ -72,11 +364,50 @@ unsigned int CollisionWorld_getNumOfLines(CollisionWorld *collisionWorld) {
   return collisionWorld->numOfLines;
 }
 
+// Store line as line i of the world.
+static inline void store_line(CollisionWorld *collisionWorld, unsigned int i,
+                              Line *line) {
+  // The SoA arrays are indexed by line ID.
+  assert(line->id == i);
+  LineSoA *soa = &collisionWorld->soa;
+  soa->p1x[i] = line->p1.x;
+  soa->p1y[i] = line->p1.y;
+  soa->p2x[i] = line->p2.x;
+  soa->p2y[i] = line->p2.y;
+  soa->p3x[i] = line->p3.x;
+  soa->p3y[i] = line->p3.y;
+  soa->p4x[i] = line->p4.x;
+  soa->p4y[i] = line->p4.y;
+  soa->vx[i] = line->velocity.x;
+  soa->vy[i] = line->velocity.y;
+
+  LineBounds *bounds = &collisionWorld->bounds;
+  Line_sweptBounds(line, collisionWorld->timeStep, &bounds->xlo[i],
+                   &bounds->ylo[i], &bounds->xhi[i], &bounds->yhi[i]);
+
+  collisionWorld->lines[i] = line;
+}
+
 void CollisionWorld_addLine(CollisionWorld *collisionWorld, Line *line) {
-  collisionWorld->lines[collisionWorld->numOfLines] = line;
+  store_line(collisionWorld, collisionWorld->numOfLines, line);
   collisionWorld->numOfLines++;
 }
 
+void CollisionWorld_addLines(CollisionWorld *collisionWorld, Line *lines,
+                             unsigned int n) {
+  unsigned int first = collisionWorld->numOfLines;
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    store_line(collisionWorld, first + i, &lines[i]);
+  }
+  collisionWorld->numOfLines += n;
+}
+
+void CollisionWorld_setLineStorage(CollisionWorld *collisionWorld,
+                                   Line *lineStorage) {
+  assert(collisionWorld->lineStorage == NULL);
+  collisionWorld->lineStorage = lineStorage;
+}
+
 Line *CollisionWorld_getLine(CollisionWorld *collisionWorld,
                              const unsigned int index) {
   if (index >= collisionWorld->numOfLines) {
@@ -86,18 +417,140 @@ Line *CollisionWorld_getLine(CollisionWorld *collisionWorld,
 }
 
 void CollisionWorld_updateLines(CollisionWorld *collisionWorld, QuadTree *q) {
-#ifdef QUADTREE
-  CollisionWorld_detectIntersection_new(collisionWorld, q);
-#else
-  CollisionWorld_detectIntersection(collisionWorld);
+  switch (collisionWorld->broadPhase) {
+  case BROAD_PHASE_BRUTE:
+    CollisionWorld_detectIntersection(collisionWorld);
+    break;
+  case BROAD_PHASE_QUADTREE:
+    CollisionWorld_detectIntersection_new(collisionWorld, q);
+    break;
+  case BROAD_PHASE_GRID:
+    CollisionWorld_detectIntersection_grid(collisionWorld);
+    break;
+  case BROAD_PHASE_SAP:
+    CollisionWorld_detectIntersection_sap(collisionWorld);
+    break;
+  case BROAD_PHASE_MORTON:
+    CollisionWorld_detectIntersection_morton(collisionWorld);
+    break;
+  case BROAD_PHASE_BVH:
+    CollisionWorld_detectIntersection_bvh(collisionWorld);
+    break;
+  case BROAD_PHASE_VERLET:
+    CollisionWorld_detectIntersection_verlet(collisionWorld);
+    break;
+  }
+  fasttime_t mark = gettime();
+  CollisionWorld_updatePositionAndWalls(collisionWorld);
+  phase_lap(&collisionWorld->phaseTimes.update, &mark);
+#ifdef COLLISION_STATS
+  record_frame_stats(collisionWorld, q);
 #endif
-  CollisionWorld_updatePosition(collisionWorld);
-  CollisionWorld_lineWallCollision(collisionWorld);
 }
 
-void CollisionWorld_updatePosition(CollisionWorld *collisionWorld) {
+#ifdef SOA
+// Advance one chunk of a coordinate array by one time step.  Each array is
+// streamed once with unit stride, so this vectorizes cleanly.
+static void soa_advance(vec_dimension *restrict p,
+                        const vec_dimension *restrict v, const unsigned int lo,
+                        const unsigned int hi, const vec_dimension t) {
+  for (unsigned int i = lo; i < hi; i++) {
+    p[i] += v[i] * t;
+  }
+}
+
+// Bounce one velocity component off the walls at lo and hi.  The two tests
+// are applied in the same order as the scalar version (hi first, then lo
+// against the possibly flipped velocity) so the results are identical.
+static inline bool bounce(const vec_dimension a, const vec_dimension b,
+                          vec_dimension *v, const double lo, const double hi) {
+  vec_dimension vi = *v;
+  bool flip_hi = ((a > hi) | (b > hi)) & (vi > 0);
+  vi = flip_hi ? -vi : vi;
+  bool flip_lo = ((a < lo) | (b < lo)) & (vi < 0);
+  vi = flip_lo ? -vi : vi;
+  *v = vi;
+  return flip_hi | flip_lo;
+}
+
+// Move lines [lo, hi) by one time step.
+static void update_position_chunk(CollisionWorld *collisionWorld,
+                                  const unsigned int lo,
+                                  const unsigned int hi) {
   double t = collisionWorld->timeStep;
-  for (int i = 0; i < collisionWorld->numOfLines; i++) {
+  LineSoA *soa = &collisionWorld->soa;
+  soa_advance(soa->p1x, soa->vx, lo, hi, t);
+  soa_advance(soa->p1y, soa->vy, lo, hi, t);
+  soa_advance(soa->p2x, soa->vx, lo, hi, t);
+  soa_advance(soa->p2y, soa->vy, lo, hi, t);
+  soa_advance(soa->p3x, soa->vx, lo, hi, t);
+  soa_advance(soa->p3y, soa->vy, lo, hi, t);
+  soa_advance(soa->p4x, soa->vx, lo, hi, t);
+  soa_advance(soa->p4y, soa->vy, lo, hi, t);
+
+  // Publish the new positions to the Line structs.
+  for (unsigned int i = lo; i < hi; i++) {
+    Line *line = collisionWorld->lines[i];
+    line->p1 = (Vec){soa->p1x[i], soa->p1y[i]};
+    line->p2 = (Vec){soa->p2x[i], soa->p2y[i]};
+    line->p3 = (Vec){soa->p3x[i], soa->p3y[i]};
+    line->p4 = (Vec){soa->p4x[i], soa->p4y[i]};
+  }
+}
+
+// Bounce lines [lo, hi) off the walls.  Returns the number of lines that hit
+// a wall.
+static unsigned int line_wall_chunk(CollisionWorld *collisionWorld,
+                                    const unsigned int lo,
+                                    const unsigned int hi) {
+  LineSoA *soa = &collisionWorld->soa;
+  const vec_dimension *restrict p1x = soa->p1x;
+  const vec_dimension *restrict p1y = soa->p1y;
+  const vec_dimension *restrict p2x = soa->p2x;
+  const vec_dimension *restrict p2y = soa->p2y;
+  vec_dimension *restrict vx = soa->vx;
+  vec_dimension *restrict vy = soa->vy;
+
+  unsigned int collisions = 0;
+  for (unsigned int i = lo; i < hi; i++) {
+    // Right/left sides, then top/bottom sides.
+    bool collide_x = bounce(p1x[i], p2x[i], &vx[i], BOX_XMIN, BOX_XMAX);
+    bool collide_y = bounce(p1y[i], p2y[i], &vy[i], BOX_YMIN, BOX_YMAX);
+    collisions += collide_x | collide_y;
+  }
+
+  // Publish the new velocities to the Line structs.
+  for (unsigned int i = lo; i < hi; i++) {
+    collisionWorld->lines[i]->velocity = (Vec){vx[i], vy[i]};
+  }
+  return collisions;
+}
+// Refresh the swept bounding boxes of lines [lo, hi), with the arithmetic of
+// Line_sweptBounds.
+static void bounds_chunk(CollisionWorld *collisionWorld, const unsigned int lo,
+                         const unsigned int hi) {
+  double t = collisionWorld->timeStep;
+  LineSoA *soa = &collisionWorld->soa;
+  LineBounds *bounds = &collisionWorld->bounds;
+  for (unsigned int i = lo; i < hi; i++) {
+    double dx = soa->vx[i] * t;
+    double dy = soa->vy[i] * t;
+    bounds->xlo[i] =
+        fmin(soa->p1x[i], soa->p2x[i]) + fmin(dx, 0) - SWEPT_BOUNDS_PAD;
+    bounds->xhi[i] =
+        fmax(soa->p1x[i], soa->p2x[i]) + fmax(dx, 0) + SWEPT_BOUNDS_PAD;
+    bounds->ylo[i] =
+        fmin(soa->p1y[i], soa->p2y[i]) + fmin(dy, 0) - SWEPT_BOUNDS_PAD;
+    bounds->yhi[i] =
+        fmax(soa->p1y[i], soa->p2y[i]) + fmax(dy, 0) + SWEPT_BOUNDS_PAD;
+  }
+}
+#else
+static void update_position_chunk(CollisionWorld *collisionWorld,
+                                  const unsigned int lo,
+                                  const unsigned int hi) {
+  double t = collisionWorld->timeStep;
+  for (unsigned int i = lo; i < hi; i++) {
     Line *line = collisionWorld->lines[i];
     line->p1 = Vec_add(line->p1, Vec_multiply(line->velocity, t));
     line->p2 = Vec_add(line->p2, Vec_multiply(line->velocity, t));
@@ -106,8 +559,11 @@ void CollisionWorld_updatePosition(CollisionWorld *collisionWorld) {
   }
 }
 
-void CollisionWorld_lineWallCollision(CollisionWorld *collisionWorld) {
-  for (int i = 0; i < collisionWorld->numOfLines; i++) {
+static unsigned int line_wall_chunk(CollisionWorld *collisionWorld,
+                                    const unsigned int lo,
+                                    const unsigned int hi) {
+  unsigned int collisions = 0;
+  for (unsigned int i = lo; i < hi; i++) {
     Line *line = collisionWorld->lines[i];
     bool collide = false;
 
@@ -135,12 +591,281 @@ void CollisionWorld_lineWallCollision(CollisionWorld *collisionWorld) {
       line->velocity.y = -line->velocity.y;
       collide = true;
     }
-    // Update total number of collisions.
     if (collide == true) {
-      numLineWallCollisions++;
+      collisions++;
     }
   }
+  return collisions;
 }
+
+// Refresh the swept bounding boxes of lines [lo, hi).
+static void bounds_chunk(CollisionWorld *collisionWorld, const unsigned int lo,
+                         const unsigned int hi) {
+  LineBounds *bounds = &collisionWorld->bounds;
+  for (unsigned int i = lo; i < hi; i++) {
+    Line_sweptBounds(collisionWorld->lines[i], collisionWorld->timeStep,
+                     &bounds->xlo[i], &bounds->ylo[i], &bounds->xhi[i],
+                     &bounds->yhi[i]);
+  }
+}
+#endif // SOA
+
+// Number of chunks of grainSize lines covering the world.
+static inline unsigned int num_chunks(CollisionWorld *collisionWorld) {
+  unsigned int g = collisionWorld->grainSize;
+  return (collisionWorld->numOfLines + g - 1) / g;
+}
+
+// Returns the end of chunk c.
+static inline unsigned int chunk_end(CollisionWorld *collisionWorld,
+                                     unsigned int c) {
+  unsigned int end = (c + 1) * collisionWorld->grainSize;
+  return end < collisionWorld->numOfLines ? end : collisionWorld->numOfLines;
+}
+
+void CollisionWorld_updatePosition(CollisionWorld *collisionWorld) {
+  unsigned int g = collisionWorld->grainSize;
+  cilk_for (unsigned int c = 0; c < num_chunks(collisionWorld); c++) {
+    unsigned int end = chunk_end(collisionWorld, c);
+    update_position_chunk(collisionWorld, c * g, end);
+    bounds_chunk(collisionWorld, c * g, end);
+  }
+}
+
+void CollisionWorld_lineWallCollision(CollisionWorld *collisionWorld) {
+  unsigned int g = collisionWorld->grainSize;
+  unsigned int cilk_reducer(zero, plus) walls = 0;
+  cilk_for (unsigned int c = 0; c < num_chunks(collisionWorld); c++) {
+    unsigned int end = chunk_end(collisionWorld, c);
+    walls += line_wall_chunk(collisionWorld, c * g, end);
+    // A bounce reverses the motion the boxes were swept along.
+    bounds_chunk(collisionWorld, c * g, end);
+  }
+  // Update total number of collisions.
+  collisionWorld->numLineWallCollisions += walls;
+}
+
+void CollisionWorld_updatePositionAndWalls(CollisionWorld *collisionWorld) {
+  unsigned int g = collisionWorld->grainSize;
+  unsigned int cilk_reducer(zero, plus) walls = 0;
+  cilk_for (unsigned int c = 0; c < num_chunks(collisionWorld); c++) {
+    // Bounce each chunk while its lines are still in cache.
+    unsigned int end = chunk_end(collisionWorld, c);
+    update_position_chunk(collisionWorld, c * g, end);
+    walls += line_wall_chunk(collisionWorld, c * g, end);
+    bounds_chunk(collisionWorld, c * g, end);
+  }
+  collisionWorld->numLineWallCollisions += walls;
+}
+
+#ifdef AABB_PREFILTER
+// Copy to near the lines among the m in others whose swept bounding boxes
+// overlap that of l1, and return how many there are.  Two lines whose boxes
+// are apart cannot meet during the coming time step, so the rest need no
+// intersection test.
+static inline unsigned int prefilter(CollisionWorld *collisionWorld,
+                                     const Line *l1, Line **others,
+                                     unsigned int m, Line **near) {
+  const LineBounds *bounds = &collisionWorld->bounds;
+  unsigned int id = l1->id;
+  double xlo = bounds->xlo[id];
+  double xhi = bounds->xhi[id];
+  double ylo = bounds->ylo[id];
+  double yhi = bounds->yhi[id];
+
+  // Test every box before compacting, so that the tests vectorize.
+  bool overlap[INTERSECT_BATCH];
+  for (unsigned int k = 0; k < m; k++) {
+    unsigned int o = others[k]->id;
+    overlap[k] = (bounds->xlo[o] <= xhi) & (xlo <= bounds->xhi[o]) &
+                 (bounds->ylo[o] <= yhi) & (ylo <= bounds->yhi[o]);
+  }
+  unsigned int c = 0;
+  for (unsigned int k = 0; k < m; k++) {
+    near[c] = others[k];
+    c += overlap[k];
+  }
+  return c;
+}
+#endif
+
+// Test l1 against each of the n lines in others, and record every intersection
+// found in the worker's event list.  Unless filter is false, pairs whose swept
+// boxes are apart are skipped first.
+static inline void test_lines(CollisionWorld *collisionWorld, Line *l1,
+                              Line **others, size_t n, const bool filter) {
+  IntersectionEventList *intersectionEventList =
+      &collisionWorld->workerEvents[worker()];
+  IntersectionType types[INTERSECT_BATCH];
+#ifdef COLLISION_STATS
+  // Count locally so the worker's counters are only written once.
+  size_t found[ALREADY_INTERSECTED + 1] = {0};
+  size_t tested = 0;
+#endif
+  for (size_t j = 0; j < n; j += INTERSECT_BATCH) {
+    unsigned int m = n - j < INTERSECT_BATCH ? n - j : INTERSECT_BATCH;
+    Line **near = &others[j];
+#ifdef AABB_PREFILTER
+    Line *overlapping[INTERSECT_BATCH];
+    if (filter) {
+      m = prefilter(collisionWorld, l1, &others[j], m, overlapping);
+      near = overlapping;
+    }
+#endif
+    intersect_batch(l1, near, m, collisionWorld->timeStep, types);
+#ifdef COLLISION_STATS
+    tested += m;
+#endif
+    for (unsigned int k = 0; k < m; k++) {
+#ifdef COLLISION_STATS
+      found[types[k]]++;
+#endif
+      if (types[k] == NO_INTERSECTION) {
+        continue;
+      }
+      // The event list expects compareLines(l1, l2) < 0 to be true.
+      Line *l2 = near[k];
+      if (compareLines(l1, l2) < 0) {
+        IntersectionEventList_append(intersectionEventList, l1, l2, types[k]);
+      } else {
+        IntersectionEventList_append(intersectionEventList, l2, l1, types[k]);
+      }
+    }
+  }
+#ifdef COLLISION_STATS
+  PairCounts *counts = &collisionWorld->workerPairCounts[worker()];
+  counts->candidatePairs += n;
+  // Rejected pairs are counted as not intersecting.
+  counts->rejectedPairs += n - tested;
+  found[NO_INTERSECTION] += n - tested;
+  for (int t = 0; t <= ALREADY_INTERSECTED; t++) {
+    counts->intersections[t] += found[t];
+  }
+#endif
+}
+
+static void check_lines(CollisionWorld *collisionWorld, Line *l1,
+                        Line **others, size_t n) {
+  test_lines(collisionWorld, l1, others, n, true);
+}
+
+// As check_lines, for broad phases that only report pairs whose swept boxes
+// overlap, which gain nothing from testing them again.
+static void check_overlapping(CollisionWorld *collisionWorld, Line *l1,
+                              Line **others, size_t n) {
+  test_lines(collisionWorld, l1, others, n, false);
+}
+
+// Sort the frame's intersection events by line IDs, call the collision solver
+// for each of them in that order, and empty the list.
+#ifdef PARALLEL_SOLVE
+// Grow *array to hold at least n elements of the given size.
+static void reserve(void **array, size_t *cap, size_t n, size_t size) {
+  if (n <= *cap) {
+    return;
+  }
+  *cap = *cap > 0 ? *cap : 64;
+  while (*cap < n) {
+    *cap *= 2;
+  }
+  *array = realloc(*array, *cap * size);
+  assert(*array);
+}
+
+// Solve sorted events in rounds.  An event goes in the round after the last
+// one that touched either of its lines, so no line appears twice in a round
+// and each line still sees its events in sorted order.  The solver only
+// touches the two lines of an event, so solving a round's events in parallel
+// gives exactly the results of the serial order.
+static void solve_in_rounds(CollisionWorld *collisionWorld,
+                            IntersectionEventList *intersectionEventList) {
+  SolveSchedule *schedule = &collisionWorld->schedule;
+  IntersectionEvent *events = intersectionEventList->events;
+  size_t n = intersectionEventList->len;
+  unsigned int *last = schedule->lastRound;
+  reserve((void **)&schedule->eventRound, &schedule->eventRoundCap, n,
+          sizeof(unsigned int));
+  unsigned int *eventRound = schedule->eventRound;
+
+  unsigned int rounds = 0;
+  for (size_t i = 0; i < n; i++) {
+    unsigned int id1 = events[i].l1->id;
+    unsigned int id2 = events[i].l2->id;
+    unsigned int r = (last[id1] > last[id2] ? last[id1] : last[id2]) + 1;
+    last[id1] = r;
+    last[id2] = r;
+    eventRound[i] = r - 1;
+    rounds = r > rounds ? r : rounds;
+  }
+
+  // Counting sort the events by round into the sort's scratch buffer, which
+  // the sort has already grown to n.
+  reserve((void **)&schedule->roundStart, &schedule->roundStartCap,
+          rounds + 1, sizeof(size_t));
+  size_t *start = schedule->roundStart;
+  memset(start, 0, sizeof(size_t) * (rounds + 1));
+  for (size_t i = 0; i < n; i++) {
+    start[eventRound[i] + 1]++;
+  }
+  for (unsigned int r = 0; r < rounds; r++) {
+    start[r + 1] += start[r];
+  }
+  assert(collisionWorld->sortScratch.cap >= n);
+  IntersectionEvent *ordered = collisionWorld->sortScratch.events;
+  for (size_t i = 0; i < n; i++) {
+    ordered[start[eventRound[i]]++] = events[i];
+    last[events[i].l1->id] = 0;
+    last[events[i].l2->id] = 0;
+  }
+
+  // The scatter advanced each round's start to the next round's start.
+  size_t begin = 0;
+  for (unsigned int r = 0; r < rounds; r++) {
+    cilk_for (size_t i = begin; i < start[r]; i++) {
+      CollisionWorld_collisionSolver(collisionWorld, ordered[i].l1,
+                                     ordered[i].l2,
+                                     ordered[i].intersectionType);
+    }
+    begin = start[r];
+  }
+}
+#endif // PARALLEL_SOLVE
+
+static void solve_events(CollisionWorld *collisionWorld) {
+  IntersectionEventList *intersectionEventList = gather_events(collisionWorld);
+  collisionWorld->numLineLineCollisions += intersectionEventList->len;
+#ifdef COLLISION_STATS
+  collisionWorld->frameEvents += intersectionEventList->len;
+#endif
+  PhaseTimes *times = &collisionWorld->phaseTimes;
+  fasttime_t mark = gettime();
+  IntersectionEventList_sort(intersectionEventList,
+                             &collisionWorld->sortScratch);
+  phase_lap(&times->sort, &mark);
+  IntersectionEventList *log = collisionWorld->eventLog;
+  if (log != NULL) {
+    for (size_t i = 0; i < intersectionEventList->len; i++) {
+      IntersectionEvent *e = &intersectionEventList->events[i];
+      IntersectionEventList_append(log, e->l1, e->l2, e->intersectionType);
+    }
+  }
+#ifdef PARALLEL_SOLVE
+  if (intersectionEventList->len >= PARALLEL_SOLVE_CUTOFF) {
+    solve_in_rounds(collisionWorld, intersectionEventList);
+    IntersectionEventList_clear(intersectionEventList);
+    phase_lap(&times->solve, &mark);
+    return;
+  }
+#endif
+  IntersectionEvent *events = intersectionEventList->events;
+  for (size_t i = 0; i < intersectionEventList->len; i++) {
+    CollisionWorld_collisionSolver(collisionWorld, events[i].l1, events[i].l2,
+                                   events[i].intersectionType);
+  }
+  IntersectionEventList_clear(intersectionEventList);
+  phase_lap(&times->solve, &mark);
+}
+
 /**
  *Number of frames = 4000
 Input file path is: input/mit.in
@@ -154,71 +879,53 @@ Elapsed execution time: 49.269134s
  *
 */
 void CollisionWorld_detectIntersection(CollisionWorld *collisionWorld) {
-  IntersectionEventList intersectionEventList = IntersectionEventList_make();
-
   // Test all line-line pairs to see if they will intersect before the
   // next time step.
+  fasttime_t mark = gettime();
   for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    Line *l1 = collisionWorld->lines[i];
-
-    for (int j = i + 1; j < collisionWorld->numOfLines; j++) {
-      Line *l2 = collisionWorld->lines[j];
-
-      // intersect expects compareLines(l1, l2) < 0 to be true.
-      // Swap l1 and l2, if necessary.
-      if (compareLines(l1, l2) >= 0) {
-        Line *temp = l1;
-        l1 = l2;
-        l2 = temp;
-      }
-
-      IntersectionType intersectionType =
-          intersect(l1, l2, collisionWorld->timeStep);
-      if (intersectionType != NO_INTERSECTION) {
-        IntersectionEventList_appendNode(&intersectionEventList, l1, l2,
-                                         intersectionType);
-        numLineLineCollisions++;
-      }
-    }
-  }
-
-  // Sort the intersection event list.
-  IntersectionEventNode *startNode = intersectionEventList.head;
-  while (startNode != NULL) {
-    IntersectionEventNode *minNode = startNode;
-    IntersectionEventNode *curNode = startNode->next;
-    while (curNode != NULL) {
-      if (IntersectionEventNode_compareData(curNode, minNode) < 0) {
-        minNode = curNode;
-      }
-      curNode = curNode->next;
-    }
-    if (minNode != startNode) {
-      IntersectionEventNode_swapData(minNode, startNode);
-    }
-    startNode = startNode->next;
-  }
-
-  // Call the collision solver for each intersection event.
-  IntersectionEventNode *curNode = intersectionEventList.head;
-
-  while (curNode != NULL) {
-    CollisionWorld_collisionSolver(collisionWorld, curNode->l1, curNode->l2,
-                                   curNode->intersectionType);
-    curNode = curNode->next;
+    check_lines(collisionWorld, collisionWorld->lines[i],
+                &collisionWorld->lines[i + 1],
+                collisionWorld->numOfLines - i - 1);
   }
+  phase_lap(&collisionWorld->phaseTimes.narrowPhase, &mark);
 
-  IntersectionEventList_deleteNodes(&intersectionEventList);
+  solve_events(collisionWorld);
 }
 
 unsigned int
 CollisionWorld_getNumLineWallCollisions(CollisionWorld *collisionWorld) {
-  return numLineWallCollisions;
+  return collisionWorld->numLineWallCollisions;
+}
+
+uint64_t CollisionWorld_velocityHash(CollisionWorld *collisionWorld) {
+  // FNV-1a over the bits of every line's velocity, in line ID order.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned int i = 0; i < collisionWorld->numOfLines; i++) {
+    Vec v = collisionWorld->lines[i]->velocity;
+    const unsigned char *bytes = (const unsigned char *)&v;
+    for (size_t b = 0; b < sizeof(Vec); b++) {
+      hash = (hash ^ bytes[b]) * 0x100000001b3ULL;
+    }
+  }
+  return hash;
 }
 
 unsigned int
 CollisionWorld_getNumLineLineCollisions(CollisionWorld *collisionWorld) {
-  return numLineLineCollisions;
+  return collisionWorld->numLineLineCollisions;
+}
+
+void CollisionWorld_setCollisionCounts(CollisionWorld *collisionWorld,
+                                       unsigned int lineWall,
+                                       unsigned int lineLine) {
+  collisionWorld->numLineWallCollisions = lineWall;
+  collisionWorld->numLineLineCollisions = lineLine;
+}
+
+// Mirror a velocity written by the collision solver into the SoA arrays.
+static inline void storeVelocity(CollisionWorld *collisionWorld, Line *line) {
+  collisionWorld->soa.vx[line->id] = line->velocity.x;
+  collisionWorld->soa.vy[line->id] = line->velocity.y;
 }
 
 void CollisionWorld_collisionSolver(CollisionWorld *collisionWorld, Line *l1,
@@ -253,6 +960,10 @@ void CollisionWorld_collisionSolver(CollisionWorld *collisionWorld, Line *l1,
       l2->velocity = Vec_multiply(Vec_normalize(Vec_subtract(l2->p1, p)),
                                   Vec_length(l2->velocity));
     }
+#ifdef SOA
+    storeVelocity(collisionWorld, l1);
+    storeVelocity(collisionWorld, l2);
+#endif
     return;
   }
 
@@ -293,21 +1004,74 @@ void CollisionWorld_collisionSolver(CollisionWorld *collisionWorld, Line *l1,
   l2->velocity =
       Vec_add(Vec_multiply(normal, newV2Normal), Vec_multiply(face, v2Face));
 
+#ifdef SOA
+  storeVelocity(collisionWorld, l1);
+  storeVelocity(collisionWorld, l2);
+#endif
   return;
 }
 
-static inline Lines *init_lines(void) {
-  Lines *l = malloc(sizeof(Lines));
-  assert(l);
-  l->len = 0;
-  l->cap = 256;
-  l->lines = malloc(l->cap * sizeof(Line *));
-  assert(l->lines);
-  return l;
+// Returns a block of four nodes from the pool.
+static Node *pool_alloc_children(NodePool *pool) {
+  if (pool->freeBlocks != NULL) {
+    Node *block = pool->freeBlocks;
+    pool->freeBlocks = block->parent;
+    return block;
+  }
+  if (pool->remaining == 0) {
+    if (pool->numSlabs == pool->slabCap) {
+      pool->slabCap = pool->slabCap == 0 ? 16 : 2 * pool->slabCap;
+      pool->slabs = realloc(pool->slabs, sizeof(Node *) * pool->slabCap);
+      assert(pool->slabs);
+    }
+    pool->next = malloc(sizeof(Node) * 4 * NODE_SLAB_BLOCKS);
+    assert(pool->next);
+    pool->slabs[pool->numSlabs++] = pool->next;
+    pool->remaining = NODE_SLAB_BLOCKS;
+  }
+  Node *block = pool->next;
+  pool->next += 4;
+  pool->remaining--;
+  return block;
 }
 
-void split_quad(Node *n) {
-  n->children = malloc(sizeof(Node *) * 4);
+// Returns a block of four leaf nodes to the pool.
+static void pool_free_children(NodePool *pool, Node *block) {
+  for (int i = 0; i < 4; ++i) {
+    assert(block[i].children == NULL);
+    node_release_lines(&block[i]);
+  }
+  block->parent = pool->freeBlocks;
+  pool->freeBlocks = block;
+}
+
+// Check if the parallelogram swept by the line lies strictly inside the node.
+static inline bool fits_in_node(Node *n, Line *l) {
+  return (l->p1.x > n->bl.x && l->p1.x < n->br.x && l->p1.y > n->bl.y &&
+          l->p1.y < n->tl.y) &&
+         (l->p2.x > n->bl.x && l->p2.x < n->br.x && l->p2.y > n->bl.y &&
+          l->p2.y < n->tl.y) &&
+         (l->p3.x > n->bl.x && l->p3.x < n->br.x && l->p3.y > n->bl.y &&
+          l->p3.y < n->tl.y) &&
+         (l->p4.x > n->bl.x && l->p4.x < n->br.x && l->p4.y > n->bl.y &&
+          l->p4.y < n->tl.y);
+}
+
+static void init_child(Node *c, Node *parent, Vec bl, Vec tl, Vec br,
+                       Vec tr) {
+  c->parent = parent;
+  c->children = NULL;
+  c->work = 0;
+  node_init_lines(c);
+  c->bl = bl;
+  c->tl = tl;
+  c->br = br;
+  c->tr = tr;
+}
+
+void split_quad(QuadTree *q, Node *n) {
+  n->children = pool_alloc_children(&q->pool);
+  q->stats.splits++;
   double mid_y = (n->bl.y + n->tl.y) / 2;
   double mid_x = (n->bl.x + n->br.x) / 2;
 
@@ -316,138 +1080,132 @@ void split_quad(Node *n) {
   Vec mid_bot = (Vec){mid_x, n->bl.y};
   Vec mid_top = (Vec){mid_x, n->tl.y};
   Vec mid = (Vec){mid_x, mid_y};
-  n->children[0] = malloc(sizeof(Node));
-  n->children[0]->parent = n;
-  n->children[0]->children = NULL;
-  n->children[0]->lines = init_lines();
-  n->children[0]->bl = n->bl;
-  n->children[0]->tl = mid_left;
-  n->children[0]->br = mid_bot;
-  n->children[0]->tr = mid;
-
-  n->children[1] = malloc(sizeof(Node));
-  n->children[1]->parent = n;
-  n->children[1]->children = NULL;
-  n->children[1]->lines = init_lines();
-  n->children[1]->bl = mid_left;
-  n->children[1]->tl = n->tl;
-  n->children[1]->br = mid;
-  n->children[1]->tr = mid_top;
-
-  n->children[2] = malloc(sizeof(Node));
-  n->children[2]->parent = n;
-  n->children[2]->children = NULL;
-  n->children[2]->lines = init_lines();
-  n->children[2]->bl = mid_bot;
-  n->children[2]->tl = mid;
-  n->children[2]->br = n->br;
-  n->children[2]->tr = mid_right;
-
-  n->children[3] = malloc(sizeof(Node));
-  n->children[3]->parent = n;
-  n->children[3]->children = NULL;
-  n->children[3]->lines = init_lines();
-  n->children[3]->bl = mid;
-  n->children[3]->tl = mid_top;
-  n->children[3]->br = mid_right;
-  n->children[3]->tr = n->tr;
-
-  Lines *not_fit = init_lines();
-  for (int i = 0; i < n->lines->len; i++) {
-    Line *l = n->lines->lines[i];
+  init_child(&n->children[0], n, n->bl, mid_left, mid_bot, mid);
+  init_child(&n->children[1], n, mid_left, n->tl, mid, mid_top);
+  init_child(&n->children[2], n, mid_bot, mid, n->br, mid_right);
+  init_child(&n->children[3], n, mid, mid_top, mid_right, n->tr);
+
+  // Lines that cannot fit stay in the parent, compacted in place.
+  size_t not_fit = 0;
+  for (int i = 0; i < n->lines.len; i++) {
+    Line *l = n->lines.lines[i];
     int fit = 0;
     for (int j = 0; j < 4; ++j) {
-      Node *c = n->children[j];
-      if ((l->p1.x > c->bl.x && l->p1.x < c->br.x && l->p1.y > c->bl.y &&
-           l->p1.y < c->tl.y) &&
-          (l->p2.x > c->bl.x && l->p2.x < c->br.x && l->p2.y > c->bl.y &&
-           l->p2.y < c->tl.y) &&
-          (l->p3.x > c->bl.x && l->p3.x < c->br.x && l->p3.y > c->bl.y &&
-           l->p3.y < c->tl.y) &&
-          (l->p4.x > c->bl.x && l->p4.x < c->br.x && l->p4.y > c->bl.y &&
-           l->p4.y < c->tl.y)) {
-        add_line(c->lines, l);
+      Node *c = &n->children[j];
+      if (fits_in_node(c, l)) {
+        node_add_line(c, l);
         l->quad_tree_node = c;
         fit = 1;
         break;
       }
     }
     if (!fit) {
-      add_line(not_fit, l);
+      n->lines.lines[not_fit++] = l;
       l->quad_tree_node = n;
     }
   }
-  if (n->parent != NULL)
-    deinit_lines(n->lines);
-  // Lines that cannot fit go back into the parent
-  n->lines = not_fit;
+  n->lines.len = not_fit;
 }
 
-static void update_line_from_leaf(Node *n, Line *l) {
+static void update_line_from_leaf(QuadTree *q, Node *n, Line *l) {
   // It fits!
-  if ((l->p1.x > n->bl.x && l->p1.x < n->br.x && l->p1.y > n->bl.y &&
-       l->p1.y < n->tl.y) &&
-      (l->p2.x > n->bl.x && l->p2.x < n->br.x && l->p2.y > n->bl.y &&
-       l->p2.y < n->tl.y) &&
-      (l->p3.x > n->bl.x && l->p3.x < n->br.x && l->p3.y > n->bl.y &&
-       l->p3.y < n->tl.y) &&
-      (l->p4.x > n->bl.x && l->p4.x < n->br.x && l->p4.y > n->bl.y &&
-       l->p4.y < n->tl.y)) {
+  if (fits_in_node(n, l)) {
     if (n->children == NULL) {
-      add_line(n->lines, l);
+      node_add_line(n, l);
       l->quad_tree_node = n;
-      if (n->lines->len > R_PARAM) {
-        return split_quad(n);
+      if (n->lines.len > R_PARAM) {
+        return split_quad(q, n);
       }
     } else {
       // We have children, try to fit into them
       for (int i = 0; i < 4; ++i) {
-        Node *c = n->children[i];
-        if ((l->p1.x > c->bl.x && l->p1.x < c->br.x && l->p1.y > c->bl.y &&
-             l->p1.y < c->tl.y) &&
-            (l->p2.x > c->bl.x && l->p2.x < c->br.x && l->p2.y > c->bl.y &&
-             l->p2.y < c->tl.y) &&
-            (l->p3.x > c->bl.x && l->p3.x < c->br.x && l->p3.y > c->bl.y &&
-             l->p3.y < c->tl.y) &&
-            (l->p4.x > c->bl.x && l->p4.x < c->br.x && l->p4.y > c->bl.y &&
-             l->p4.y < c->tl.y)) {
-          add_line(c->lines, l);
+        Node *c = &n->children[i];
+        if (fits_in_node(c, l)) {
+          node_add_line(c, l);
           l->quad_tree_node = c;
           return;
         }
       }
-      add_line(n->lines, l);
+      node_add_line(n, l);
       l->quad_tree_node = n;
     }
   } else {
     if (n->parent != NULL) {
-      return update_line_from_leaf(n->parent, l);
+      return update_line_from_leaf(q, n->parent, l);
     }
-    add_line(n->lines, l);
+    node_add_line(n, l);
     l->quad_tree_node = n;
   }
 }
 
+uint64_t quadtree_placement(const Line *line) {
+  const Node *n = line->quad_tree_node;
+  if (n == NULL) {
+    return 0;
+  }
+  uint64_t path = 0;
+  unsigned int shift = 0;
+  for (; n->parent != NULL; n = n->parent) {
+    if (shift == 62) {
+      return 0;
+    }
+    path |= (uint64_t)(n - n->parent->children) << shift;
+    shift += 2;
+  }
+  return path | (uint64_t)1 << shift;
+}
+
+// Returns the node named by a placement code, splitting nodes on the way.
+static Node *placed_node(QuadTree *q, uint64_t code) {
+  Node *n = q->root;
+  for (int shift = 61 - __builtin_clzll(code); shift >= 0; shift -= 2) {
+    if (n->children == NULL) {
+      split_quad(q, n);
+    }
+    n = &n->children[(code >> shift) & 3];
+  }
+  return n;
+}
+
+// Rebuild the tree with every line in the node recorded in the world's
+// placement.  Every node is split before any line is added, so that no split
+// moves a line out of its recorded node.
+static void place_lines(QuadTree *q, CollisionWorld *collisionWorld) {
+  uint64_t *placement = collisionWorld->quadtreePlacement;
+  for (unsigned int i = 0; i < collisionWorld->numOfLines; ++i) {
+    placed_node(q, placement[i]);
+  }
+  for (unsigned int i = 0; i < collisionWorld->numOfLines; ++i) {
+    Node *n = placed_node(q, placement[i]);
+    node_add_line(n, collisionWorld->lines[i]);
+    collisionWorld->lines[i]->quad_tree_node = n;
+  }
+  free(placement);
+  collisionWorld->quadtreePlacement = NULL;
+}
+
 QuadTree build_quadtree(CollisionWorld *collisionWorld) {
   QuadTree qt = {0};
   qt.root = malloc(sizeof(Node));
   qt.root->parent = NULL;
   qt.root->children = NULL;
+  qt.root->work = 0;
   qt.root->bl = (Vec){BOX_XMIN, BOX_YMIN};
   qt.root->tl = (Vec){BOX_XMIN, BOX_YMAX};
   qt.root->br = (Vec){BOX_XMAX, BOX_YMIN};
   qt.root->tr = (Vec){BOX_XMAX, BOX_YMAX};
 
+  node_init_lines(qt.root);
+  if (collisionWorld->quadtreePlacement != NULL) {
+    place_lines(&qt, collisionWorld);
+    qt.stats = (QuadTreeStats){0};
+    return qt;
+  }
   for (int i = 0; i < collisionWorld->numOfLines; ++i) {
+    node_add_line(qt.root, collisionWorld->lines[i]);
     collisionWorld->lines[i]->quad_tree_node = qt.root;
   }
-  Lines *root_line = malloc(sizeof(Lines));
-  root_line->cap = collisionWorld->numOfLines;
-  root_line->len = collisionWorld->numOfLines;
-  root_line->lines = collisionWorld->lines;
-  qt.root->lines = root_line;
 
-  int r = 3;
   NodeQueue q = {0};
   q.size = 0;
   q.cap = 256;
@@ -456,188 +1214,455 @@ QuadTree build_quadtree(CollisionWorld *collisionWorld) {
 
   while (q.size > 0) {
     Node *n = pop(&q);
-    if (n->lines != NULL && n->lines->len > r) {
-      split_quad(n);
-      push(&q, n->children[0]);
-      push(&q, n->children[1]);
-      push(&q, n->children[2]);
-      push(&q, n->children[3]);
+    if (n->lines.len > R_PARAM) {
+      split_quad(&qt, n);
+      push(&q, &n->children[0]);
+      push(&q, &n->children[1]);
+      push(&q, &n->children[2]);
+      push(&q, &n->children[3]);
     }
   }
   free(q.nodes);
+  // Only count the work of keeping the tree up to date.
+  qt.stats = (QuadTreeStats){0};
   return qt;
 }
 
-Lines *merge_lines(Lines *l1, Lines *l2) {
-  if (l1 == NULL && l2 == NULL)
-    return NULL;
-  Lines *ret = malloc(sizeof(Lines));
-  assert(ret);
-  if (l2 == NULL || l2->lines == NULL) {
-    ret->len = l1->len;
-    ret->cap = l1->cap;
-    ret->lines = malloc(ret->cap * sizeof(Line *));
-    assert(ret->lines);
-    memcpy(ret->lines, l1->lines, sizeof(Line *) * l1->len);
-  } else if (l1 == NULL || l1->lines == NULL) {
-    ret->len = l2->len;
-    ret->cap = l2->cap;
-    ret->lines = malloc(ret->cap * sizeof(Line *));
-    assert(ret->lines);
-    memcpy(ret->lines, l2->lines, sizeof(Line *) * l2->len);
-  } else {
-    ret->len = l1->len + l2->len;
-    ret->cap = l1->len + l2->len;
-    ret->lines = malloc(ret->cap * sizeof(Line *));
-    assert(ret->lines);
-    memcpy(ret->lines, l1->lines, sizeof(Line *) * l1->len);
-    memcpy(&ret->lines[l1->len], l2->lines, sizeof(Line *) * l2->len);
+static void delete_node_lines(Node *n) {
+  if (n->children != NULL) {
+    for (int i = 0; i < 4; ++i) {
+      delete_node_lines(&n->children[i]);
+    }
   }
-  return ret;
+  node_release_lines(n);
 }
 
-void new_list(void *view) {
-  *(IntersectionEventList *)view =
-      (IntersectionEventList){.head = NULL, .tail = NULL};
+void delete_quadtree(QuadTree *q) {
+  delete_node_lines(q->root);
+  free(q->root);
+  for (size_t i = 0; i < q->pool.numSlabs; ++i) {
+    free(q->pool.slabs[i]);
+  }
+  free(q->pool.slabs);
+  *q = (QuadTree){0};
 }
 
-void list_reduce(void *left, void *right) {
-  if (((IntersectionEventList *)left)->head == NULL) {
-    ((IntersectionEventList *)left)->head =
-        ((IntersectionEventList *)right)->head;
-  } else if (((IntersectionEventList *)left)->tail == NULL) {
-    ((IntersectionEventList *)left)->tail =
-        ((IntersectionEventList *)right)->head;
-  } else {
-    ((IntersectionEventList *)left)->tail->next =
-        ((IntersectionEventList *)right)->head;
+// Pairs tested by a node holding len lines below ancestors holding above.
+static inline size_t node_work(size_t len, size_t above) {
+  return len * (len - 1) / 2 + len * above;
+}
+
+// Collapse every subtree that holds at most COLLAPSE_PARAM lines into its
+// root, and return the children of any node whose subtree no longer holds a
+// line to the pool.  Also refreshes the work of every node, given the number
+// of lines held by n's ancestors.  Returns the number of lines in n's subtree.
+static size_t collapse_sparse(QuadTree *q, Node *n, size_t above) {
+  size_t count = n->lines.len;
+  if (n->children == NULL) {
+    n->work = node_work(count, above);
+    return count;
+  }
+  size_t below = 0;
+  size_t work = node_work(count, above);
+  for (int i = 0; i < 4; ++i) {
+    below += collapse_sparse(q, &n->children[i], above + count);
+    work += n->children[i].work;
+  }
+  if (below == 0 || count + below <= COLLAPSE_PARAM) {
+    // The children are leaves by now, since their subtrees are even smaller.
+    for (int i = 0; i < 4; ++i) {
+      Node *c = &n->children[i];
+      for (size_t j = 0; j < c->lines.len; ++j) {
+        node_add_line(n, c->lines.lines[j]);
+        c->lines.lines[j]->quad_tree_node = n;
+      }
+    }
+    pool_free_children(&q->pool, n->children);
+    n->children = NULL;
+    q->stats.merges++;
+    work = node_work(count + below, above);
   }
-  ((IntersectionEventList *)left)->tail =
-      ((IntersectionEventList *)right)->tail;
+  n->work = work;
+  return count + below;
 }
 
-IntersectionEventList cilk_reducer(new_list, list_reduce)
-    intersectionEventList = (IntersectionEventList){.head = NULL, .tail = NULL};
+// One link in the chain of lines held by a node's ancestors.  Each call of
+// check_collision pushes its own node's lines as a link on its stack frame, so
+// children read every ancestor's lines in place instead of copying them.  The
+// chain is never modified once built, so spawned children can share it.
+typedef struct AncestorLines {
+  const Lines *lines;
+  const struct AncestorLines *next;
+} AncestorLines;
 
-void check_collision(CollisionWorld *collisionWorld, Node *n, Lines *prev) {
+void check_collision(CollisionWorld *collisionWorld, Node *n,
+                     const AncestorLines *ancestors) {
   if (n == NULL)
     return;
   // Test lines within node itself
-  if (n->lines != NULL) {
-    for (int i = 0; i < n->lines->len; ++i) {
-      Line *l1 = n->lines->lines[i];
-      for (int j = i + 1; j < n->lines->len; ++j) {
-        Line *l2 = n->lines->lines[j];
-        IntersectionType intersectionType;
-        // intersect expects compareLines(l1, l2) < 0 to be true.
-        // Swap l1 and l2, if necessary.
-        Line *temp = l1;
-
-        if (compareLines(l1, l2) >= 0) {
-          temp = l2;
-          l2 = l1;
-        }
-        intersectionType = intersect(temp, l2, collisionWorld->timeStep);
-        if (intersectionType != NO_INTERSECTION) {
-          IntersectionEventList_appendNode(&intersectionEventList, temp, l2,
-                                           intersectionType);
-          numLineLineCollisions++;
-        }
-      }
-    }
-    if (prev != NULL && prev->lines != NULL) {
-      // Test previous lines against new lines
-      for (int i = 0; i < prev->len; ++i) {
-        Line *l1 = prev->lines[i];
-        for (int j = 0; j < n->lines->len; ++j) {
-          Line *l2 = n->lines->lines[j];
-          IntersectionType intersectionType;
-          // intersect expects compareLines(l1, l2) < 0 to be true.
-          // Swap l1 and l2, if necessary.
-          Line *temp = l1;
-
-          if (compareLines(l1, l2) >= 0) {
-            temp = l2;
-            l2 = l1;
-          }
-          intersectionType = intersect(temp, l2, collisionWorld->timeStep);
-          if (intersectionType != NO_INTERSECTION) {
-            IntersectionEventList_appendNode(&intersectionEventList, temp, l2,
-                                             intersectionType);
-            numLineLineCollisions++;
-          }
-        }
+  Lines *lines = &n->lines;
+  for (int i = 0; i < lines->len; ++i) {
+    check_lines(collisionWorld, lines->lines[i], &lines->lines[i + 1],
+                lines->len - i - 1);
+  }
+  if (lines->len > 0) {
+    // Test ancestors' lines against new lines
+    for (const AncestorLines *a = ancestors; a != NULL; a = a->next) {
+      for (int i = 0; i < a->lines->len; ++i) {
+        check_lines(collisionWorld, a->lines->lines[i], lines->lines,
+                    lines->len);
       }
     }
   }
-  Lines *new[] = {merge_lines(prev, n->lines), merge_lines(prev, n->lines),
-                  merge_lines(prev, n->lines), merge_lines(prev, n->lines)};
+  if (n->children == NULL) {
+    return;
+  }
+
+  // Empty nodes add nothing to the chain.  Children with enough work below
+  // them are spawned, the rest are traversed in place and those with no work
+  // are skipped.
+  AncestorLines self = {lines, ancestors};
+  const AncestorLines *chain = lines->len > 0 ? &self : ancestors;
   cilk_scope {
-    if (n->children != NULL) {
-      for (int i = 0; i < 4; ++i) {
-        cilk_spawn check_collision(collisionWorld, n->children[i], new[i]);
-        // check_collision(collisionWorld, n->children[i], new[i]);
+    for (int i = 0; i < 4; ++i) {
+      Node *c = &n->children[i];
+      if (c->work > collisionWorld->spawnCutoff) {
+        cilk_spawn check_collision(collisionWorld, c, chain);
+      } else if (c->work > 0) {
+        check_collision(collisionWorld, c, chain);
       }
     }
   }
+}
 
-  for (int i = 0; i < 4; ++i) {
-    deinit_lines(new[i]);
+static inline void remove_line_from_node(Node *n, Line *l) {
+  assert(n->lines.len > 0);
+  Line **lines = n->lines.lines;
+  // Compare pointers rather than IDs so the scan does not touch every line.
+  // The order of a node's lines does not matter, so fill the gap with the
+  // last line.
+  for (size_t i = 0; i < n->lines.len; ++i) {
+    if (lines[i] == l) {
+      lines[i] = lines[n->lines.len - 1];
+      break;
+    }
   }
+  n->lines.len--;
 }
 
-static inline void remove_line_from_node(Node *n, unsigned int id) {
-  assert(n->lines->len > 0);
-  Line **lines = n->lines->lines;
-  for (int i = 0; i < n->lines->len - 1; ++i) {
-    if (lines[i]->id == id) {
-      memmove(&lines[i], &lines[i + 1], sizeof(Line *) * n->lines->len - i - 1);
-      break;
+// Move the line to the node a fresh insertion from its current node would put
+// it in.  Most lines are still contained in their node and cannot move down,
+// so they are left alone.  Returns true if the line was moved.
+static bool relocate_line(QuadTree *q, Line *l) {
+  Node *n = l->quad_tree_node;
+  if (!fits_in_node(n, l)) {
+    // Crossed a boundary: climb from the parent.
+    remove_line_from_node(n, l);
+    l->quad_tree_node = NULL;
+    update_line_from_leaf(q, n->parent != NULL ? n->parent : n, l);
+    return true;
+  }
+  if (n->children == NULL) {
+    if (n->lines.len <= R_PARAM) {
+      return false;
+    }
+    // An overfull leaf is split by re-inserting any of its lines.
+    remove_line_from_node(n, l);
+    update_line_from_leaf(q, n, l);
+    return true;
+  }
+  for (int i = 0; i < 4; ++i) {
+    Node *c = &n->children[i];
+    if (fits_in_node(c, l)) {
+      remove_line_from_node(n, l);
+      node_add_line(c, l);
+      l->quad_tree_node = c;
+      return true;
     }
   }
-  n->lines->len--;
+  return false;
 }
 
-void update_quadtree(CollisionWorld *c) {
+void update_quadtree(CollisionWorld *c, QuadTree *q) {
   for (int i = 0; i < c->numOfLines; ++i) {
-    Line *l = c->lines[i];
-    Node *n = l->quad_tree_node;
-    remove_line_from_node(n, l->id);
-    l->quad_tree_node = NULL;
-    update_line_from_leaf(n, l);
+    q->stats.linesMoved += relocate_line(q, c->lines[i]);
   }
+  collapse_sparse(q, q->root, 0);
+  q->stats.updates++;
 }
 
 void CollisionWorld_detectIntersection_new(CollisionWorld *collisionWorld,
                                            QuadTree *q) {
   // *q = build_quadtree(collisionWorld);
-  update_quadtree(collisionWorld);
+  PhaseTimes *times = &collisionWorld->phaseTimes;
+  fasttime_t mark = gettime();
+  update_quadtree(collisionWorld, q);
+  phase_lap(&times->broadPhase, &mark);
   check_collision(collisionWorld, q->root, NULL);
-  // Sort the intersection event list.
-  IntersectionEventNode *startNode = intersectionEventList.head;
-  while (startNode != NULL) {
-    IntersectionEventNode *minNode = startNode;
-    IntersectionEventNode *curNode = startNode->next;
-    while (curNode != NULL) {
-      if (IntersectionEventNode_compareData(curNode, minNode) < 0) {
-        minNode = curNode;
+  phase_lap(&times->narrowPhase, &mark);
+  solve_events(collisionWorld);
+}
+
+// Test the pairs of lines listed in one grid cell.  A pair that shares several
+// cells is only tested in the lower-left cell of the overlap of their ranges.
+static void check_cell(CollisionWorld *collisionWorld, Grid *grid,
+                       unsigned int x, unsigned int y) {
+  unsigned int c = Grid_cell(grid, x, y);
+  Line **lines = &grid->cellLines[grid->cellStart[c]];
+  unsigned int len = grid->cellStart[c + 1] - grid->cellStart[c];
+  Line *candidates[INTERSECT_BATCH];
+
+  for (unsigned int i = 0; i < len; ++i) {
+    Line *l1 = lines[i];
+    unsigned int x1 = grid->x0[l1->id];
+    unsigned int y1 = grid->y0[l1->id];
+    unsigned int k = 0;
+    for (unsigned int j = i + 1; j < len; ++j) {
+      Line *l2 = lines[j];
+      unsigned int x2 = grid->x0[l2->id];
+      unsigned int y2 = grid->y0[l2->id];
+      if ((x1 > x2 ? x1 : x2) != x || (y1 > y2 ? y1 : y2) != y) {
+        continue;
+      }
+      candidates[k++] = l2;
+      if (k == INTERSECT_BATCH) {
+        check_lines(collisionWorld, l1, candidates, k);
+        k = 0;
       }
-      curNode = curNode->next;
     }
-    if (minNode != startNode) {
-      IntersectionEventNode_swapData(minNode, startNode);
+    check_lines(collisionWorld, l1, candidates, k);
+  }
+}
+
+void CollisionWorld_detectIntersection_grid(CollisionWorld *collisionWorld) {
+  PhaseTimes *times = &collisionWorld->phaseTimes;
+  fasttime_t mark = gettime();
+  if (collisionWorld->grid == NULL) {
+    collisionWorld->grid = Grid_new(collisionWorld);
+  }
+  Grid *grid = collisionWorld->grid;
+  Grid_build(grid, collisionWorld);
+  phase_lap(&times->broadPhase, &mark);
+
+  cilk_for (unsigned int c = 0; c < grid->dimX * grid->dimY; ++c) {
+    check_cell(collisionWorld, grid, c % grid->dimX, c / grid->dimX);
+  }
+  phase_lap(&times->narrowPhase, &mark);
+  solve_events(collisionWorld);
+}
+
+// Test the line at position i of the sorted list against the lines after it
+// whose swept boxes overlap its own.  Those all start, along x, before line i
+// ends, so the scan stops at the first one that does not.
+static void sweep_line(CollisionWorld *collisionWorld, SweepAndPrune *sap,
+                       unsigned int i) {
+  SapEntry *entries = sap->entries;
+  SapEntry *e = &entries[i];
+  Line *candidates[INTERSECT_BATCH];
+  unsigned int k = 0;
+
+  for (unsigned int j = i + 1;
+       j < sap->numOfEntries && entries[j].xlo <= e->xhi; ++j) {
+    if (entries[j].ylo > e->yhi || entries[j].yhi < e->ylo) {
+      continue;
+    }
+    candidates[k++] = entries[j].line;
+    if (k == INTERSECT_BATCH) {
+      check_overlapping(collisionWorld, e->line, candidates, k);
+      k = 0;
+    }
+  }
+  check_overlapping(collisionWorld, e->line, candidates, k);
+}
+
+void CollisionWorld_detectIntersection_sap(CollisionWorld *collisionWorld) {
+  PhaseTimes *times = &collisionWorld->phaseTimes;
+  fasttime_t mark = gettime();
+  if (collisionWorld->sap == NULL) {
+    collisionWorld->sap = SweepAndPrune_new(collisionWorld);
+  } else {
+    SweepAndPrune_update(collisionWorld->sap, collisionWorld);
+  }
+  SweepAndPrune *sap = collisionWorld->sap;
+  phase_lap(&times->broadPhase, &mark);
+
+  cilk_for (unsigned int i = 0; i < sap->numOfEntries; ++i) {
+    sweep_line(collisionWorld, sap, i);
+  }
+  phase_lap(&times->narrowPhase, &mark);
+  solve_events(collisionWorld);
+}
+
+// Test the line at position i of the linear quadtree against the lines after
+// it in the same node or below it.  Those are exactly the following entries
+// whose codes fall inside the node, so the scan stops at the first one that
+// does not.  Pairs whose swept boxes do not overlap are skipped.
+static void scan_subtree(CollisionWorld *collisionWorld, LinearQuadTree *tree,
+                         unsigned int i) {
+  MortonEntry *entries = tree->entries;
+  MortonEntry *e = &entries[i];
+  Line *candidates[INTERSECT_BATCH];
+  unsigned int k = 0;
+
+  for (unsigned int j = i + 1;
+       j < tree->numOfEntries && entries[j].code < e->end; ++j) {
+    if (entries[j].xlo > e->xhi || entries[j].xhi < e->xlo ||
+        entries[j].ylo > e->yhi || entries[j].yhi < e->ylo) {
+      continue;
+    }
+    candidates[k++] = entries[j].line;
+    if (k == INTERSECT_BATCH) {
+      check_overlapping(collisionWorld, e->line, candidates, k);
+      k = 0;
+    }
+  }
+  check_overlapping(collisionWorld, e->line, candidates, k);
+}
+
+void CollisionWorld_detectIntersection_morton(CollisionWorld *collisionWorld) {
+  PhaseTimes *times = &collisionWorld->phaseTimes;
+  fasttime_t mark = gettime();
+  if (collisionWorld->linearQuadTree == NULL) {
+    collisionWorld->linearQuadTree = LinearQuadTree_new(collisionWorld);
+  }
+  LinearQuadTree *tree = collisionWorld->linearQuadTree;
+  LinearQuadTree_build(tree, collisionWorld);
+  phase_lap(&times->broadPhase, &mark);
+
+  cilk_for (unsigned int i = 0; i < tree->numOfEntries; ++i) {
+    scan_subtree(collisionWorld, tree, i);
+  }
+  phase_lap(&times->narrowPhase, &mark);
+  solve_events(collisionWorld);
+}
+
+// Test line i of the tree against the lines from first up to end whose swept
+// boxes overlap its own.  The range is never longer than a leaf.
+static inline void check_against_leaf(CollisionWorld *collisionWorld,
+                                      Bvh *bvh, unsigned int i,
+                                      unsigned int first, unsigned int end) {
+  Line *candidates[BVH_LEAF_SIZE];
+  unsigned int k = 0;
+  for (unsigned int j = first; j < end; ++j) {
+    if (BvhBox_overlap(&bvh->boxes[i], &bvh->boxes[j])) {
+      candidates[k++] = bvh->lines[j];
+    }
+  }
+  check_overlapping(collisionWorld, bvh->lines[i], candidates, k);
+}
+
+// Test every line under node a against every line under node b.
+static void bvh_pair(CollisionWorld *collisionWorld, Bvh *bvh,
+                     const BvhNode *a, const BvhNode *b) {
+  if (!BvhBox_overlap(&a->box, &b->box)) {
+    return;
+  }
+  if (a->left == 0 && b->left == 0) {
+    for (unsigned int i = a->first; i < a->first + a->count; ++i) {
+      check_against_leaf(collisionWorld, bvh, i, b->first,
+                         b->first + b->count);
+    }
+    return;
+  }
+  // Descend into the larger of the two nodes that is not a leaf.
+  if (a->left == 0 || (b->left != 0 && b->count > a->count)) {
+    const BvhNode *t = a;
+    a = b;
+    b = t;
+  }
+  const BvhNode *left = &bvh->nodes[a->left];
+  const BvhNode *right = &bvh->nodes[a->right];
+  if (a->count + b->count > BVH_SPAWN_CUTOFF) {
+    cilk_scope {
+      cilk_spawn bvh_pair(collisionWorld, bvh, left, b);
+      bvh_pair(collisionWorld, bvh, right, b);
+    }
+  } else {
+    bvh_pair(collisionWorld, bvh, left, b);
+    bvh_pair(collisionWorld, bvh, right, b);
+  }
+}
+
+// Test every pair of lines under node n: the pairs within each child, and the
+// pairs with one line in each.
+static void bvh_self(CollisionWorld *collisionWorld, Bvh *bvh,
+                     const BvhNode *n) {
+  if (n->left == 0) {
+    for (unsigned int i = n->first; i < n->first + n->count; ++i) {
+      check_against_leaf(collisionWorld, bvh, i, i + 1, n->first + n->count);
+    }
+    return;
+  }
+  const BvhNode *left = &bvh->nodes[n->left];
+  const BvhNode *right = &bvh->nodes[n->right];
+  if (n->count > BVH_SPAWN_CUTOFF) {
+    cilk_scope {
+      cilk_spawn bvh_self(collisionWorld, bvh, left);
+      cilk_spawn bvh_self(collisionWorld, bvh, right);
+      bvh_pair(collisionWorld, bvh, left, right);
     }
-    startNode = startNode->next;
+  } else {
+    bvh_self(collisionWorld, bvh, left);
+    bvh_self(collisionWorld, bvh, right);
+    bvh_pair(collisionWorld, bvh, left, right);
   }
+}
 
-  // Call the collision solver for each intersection event.
-  IntersectionEventNode *curNode = intersectionEventList.head;
+void CollisionWorld_detectIntersection_bvh(CollisionWorld *collisionWorld) {
+  PhaseTimes *times = &collisionWorld->phaseTimes;
+  fasttime_t mark = gettime();
+  if (collisionWorld->bvh == NULL) {
+    collisionWorld->bvh = Bvh_new(collisionWorld);
+  } else {
+    Bvh_update(collisionWorld->bvh, collisionWorld);
+  }
+  Bvh *bvh = collisionWorld->bvh;
+  phase_lap(&times->broadPhase, &mark);
 
-  while (curNode != NULL) {
-    CollisionWorld_collisionSolver(collisionWorld, curNode->l1, curNode->l2,
-                                   curNode->intersectionType);
-    curNode = curNode->next;
+  if (bvh->numOfLines > 0) {
+    bvh_self(collisionWorld, bvh, &bvh->nodes[0]);
   }
+  phase_lap(&times->narrowPhase, &mark);
+  solve_events(collisionWorld);
+}
+
+// Test the line of entries[i] of the pair cache against its cached partners
+// whose current swept boxes overlap its own.
+static void check_cached(CollisionWorld *collisionWorld, PairCache *cache,
+                         unsigned int i) {
+  Line *l1 = cache->entries[i].line;
+  const PairBox *box = &cache->current[l1->id];
+  Line *candidates[INTERSECT_BATCH];
+  unsigned int k = 0;
 
-  IntersectionEventList_deleteNodes(&intersectionEventList);
+  for (size_t j = cache->start[i]; j < cache->start[i + 1]; ++j) {
+    Line *l2 = cache->partners[j];
+    if (!PairBox_overlap(box, &cache->current[l2->id])) {
+      continue;
+    }
+    candidates[k++] = l2;
+    if (k == INTERSECT_BATCH) {
+      check_overlapping(collisionWorld, l1, candidates, k);
+      k = 0;
+    }
+  }
+  check_overlapping(collisionWorld, l1, candidates, k);
+}
+
+void CollisionWorld_detectIntersection_verlet(CollisionWorld *collisionWorld) {
+  PhaseTimes *times = &collisionWorld->phaseTimes;
+  fasttime_t mark = gettime();
+  if (collisionWorld->pairCache == NULL) {
+    collisionWorld->pairCache = PairCache_new(collisionWorld);
+  } else {
+    PairCache_update(collisionWorld->pairCache, collisionWorld);
+  }
+  PairCache *cache = collisionWorld->pairCache;
+  phase_lap(&times->broadPhase, &mark);
+
+  cilk_for (unsigned int i = 0; i < cache->numOfLines; ++i) {
+    check_cached(collisionWorld, cache, i);
+  }
+  phase_lap(&times->narrowPhase, &mark);
+  solve_events(collisionWorld);
 }
@@ -25,8 +25,121 @@
 #define COLLISIONWORLD_H_
 
 #include "./intersection_detection.h"
+#include "./intersection_event_list.h"
 #include "./line.h"
 #include <cilk/cilk.h>
+#include <stdio.h>
+
+// The broad phases that can be used to find candidate pairs of lines.
+typedef enum {
+  BROAD_PHASE_BRUTE,    // test every pair of lines
+  BROAD_PHASE_QUADTREE, // pairs in the same or an ancestor quadtree node
+  BROAD_PHASE_GRID,     // pairs sharing a cell of a uniform grid
+  BROAD_PHASE_SAP,      // pairs whose swept boxes overlap, by sweep-and-prune
+  BROAD_PHASE_MORTON,   // same or ancestor node of a Morton-ordered quadtree
+  BROAD_PHASE_BVH,      // pairs of overlapping leaves of a refit BVH
+  BROAD_PHASE_VERLET    // pairs from a list reused while lines stay near
+} BroadPhase;
+
+// Parse a broad phase name ("brute", "quadtree", "grid", "sap", "morton",
+// "bvh", "verlet").  Returns false if the name is not recognized.
+bool BroadPhase_parse(const char *name, BroadPhase *broadPhase);
+
+// Returns the name of the broad phase.
+const char *BroadPhase_name(BroadPhase broadPhase);
+
+// Default number of lines per parallel chunk of the position and wall
+// updates.
+#define DEFAULT_GRAIN_SIZE 1024
+
+// Default number of pairs a quadtree subtree must test for its traversal to
+// be spawned rather than called serially.
+#define DEFAULT_SPAWN_CUTOFF 2048
+
+struct Grid;
+struct SweepAndPrune;
+struct LinearQuadTree;
+struct Bvh;
+struct PairCache;
+
+// Structure-of-arrays copy of the lines' kinematic state, indexed by line ID.
+// In SOA mode these arrays are authoritative for positions and velocities,
+// and the Line structs are refreshed from them after every update so that
+// intersection detection and the renderer can keep working on Line*.
+typedef struct {
+  vec_dimension *p1x, *p1y;
+  vec_dimension *p2x, *p2y;
+  vec_dimension *p3x, *p3y;
+  vec_dimension *p4x, *p4y;
+  vec_dimension *vx, *vy;
+} LineSoA;
+
+// Bounding box of the region each line sweeps during the coming time step, as
+// given by Line_sweptBounds, indexed by line ID.  The boxes are refreshed
+// whenever the lines move or bounce off a wall.
+typedef struct {
+  double *xlo, *xhi;
+  double *ylo, *yhi;
+} LineBounds;
+
+// Wall-clock time spent in each phase of CollisionWorld_updateLines, summed
+// over every frame, in seconds.  Candidate pairs are generated while the
+// broad phase structure is traversed, so narrowPhase covers the traversal and
+// the intersection tests, and broadPhase only building or updating the
+// structure.  The position update and wall collision run fused, so they share
+// one timer.
+typedef struct {
+  double broadPhase;
+  double narrowPhase;
+  double sort;
+  double solve;
+  double update;
+} PhaseTimes;
+
+#ifdef COLLISION_STATS
+// Counters describing the work done by the collision pipeline, summed over
+// every frame.  Only maintained when built with COLLISION_STATS.
+typedef struct {
+  size_t frames;
+  // Pairs of lines handed to the narrow phase.
+  size_t candidatePairs;
+  // Narrow phase results, indexed by IntersectionType.
+  size_t intersections[ALREADY_INTERSECTED + 1];
+  // Candidate pairs found to be NO_INTERSECTION by their bounding boxes
+  // alone, without an intersection test.
+  size_t rejectedPairs;
+  // Intersection events solved, and the most in a single frame.
+  size_t events;
+  size_t maxEvents;
+  // Shape of the quadtree after each update, for the quadtree broad phase.
+  size_t quadtreeNodes;
+  size_t quadtreeLeaves;
+  size_t quadtreeDepth;
+  size_t maxQuadtreeDepth;
+  // Lines held by the root, which are tested against every other line.
+  size_t rootLines;
+} CollisionStats;
+
+// Narrow phase counters of one worker for the current frame.
+typedef struct {
+  size_t candidatePairs;
+  size_t intersections[ALREADY_INTERSECTED + 1];
+  size_t rejectedPairs;
+} PairCounts;
+#endif
+
+// Scratch space for scheduling a frame's events into parallel rounds.
+typedef struct {
+  // Last round that touched each line, indexed by line ID.  All zero between
+  // frames.
+  unsigned int *lastRound;
+  // Round of each event.
+  unsigned int *eventRound;
+  size_t eventRoundCap;
+  // Start of each round in the events ordered by round.
+  size_t *roundStart;
+  size_t roundStartCap;
+} SolveSchedule;
 
 struct CollisionWorld {
   // Time step used for simulation
@@ -36,6 +149,80 @@ struct CollisionWorld {
   // This CollisionWorld owns the Line* lines.
   Line **lines;
   unsigned int numOfLines;
+
+  // If not NULL, every line points into this one allocation, which is freed
+  // in place of the individual lines.
+  Line *lineStorage;
+
+  // If not NULL, the quadtree node of every line, indexed by line ID, as
+  // returned by quadtree_placement.  The next build_quadtree puts every line
+  // back in its node and frees this.
+  uint64_t *quadtreePlacement;
+
+  // Hot position/velocity state, only maintained in SOA mode.
+  LineSoA soa;
+
+  // Swept bounding boxes, checked before each intersection test.
+  LineBounds bounds;
+
+  // Events detected in the current frame, in one list per worker, indexed by
+  // worker number.
+  IntersectionEventList *workerEvents;
+  unsigned int numOfWorkers;
+
+  // Collisions so far.
+  unsigned int numLineWallCollisions;
+  unsigned int numLineLineCollisions;
+
+  // Second buffer for sorting each frame's intersection events.
+  IntersectionEventList sortScratch;
+
+  // Round assignment for the parallel collision solver.
+  SolveSchedule schedule;
+
+  // Lines per parallel chunk of the position and wall updates.
+  unsigned int grainSize;
+
+  // Quadtree subtrees testing at most this many pairs are traversed serially.
+  size_t spawnCutoff;
+
+  // Time spent in each phase so far.
+  PhaseTimes phaseTimes;
+
+  // If not NULL, every event solved is also appended here, in the order of
+  // the sorted event list.
+  IntersectionEventList *eventLog;
+
+#ifdef COLLISION_STATS
+  // Pipeline counters so far, and a file that receives one CSV row of the
+  // counters for every frame, or NULL.
+  CollisionStats stats;
+  FILE *statsDump;
+  // Narrow phase counters of the current frame, one per worker, and events
+  // solved in it.
+  PairCounts *workerPairCounts;
+  size_t frameEvents;
+#endif
+
+  // Broad phase used by CollisionWorld_updateLines.
+  BroadPhase broadPhase;
+
+  // Uniform grid, created on first use by the grid broad phase.
+  struct Grid *grid;
+
+  // Lines sorted along x, created on first use by the sweep-and-prune broad
+  // phase.
+  struct SweepAndPrune *sap;
+
+  // Morton-ordered quadtree, created on first use by the morton broad phase.
+  struct LinearQuadTree *linearQuadTree;
+
+  // Bounding volume hierarchy, created on first use by the bvh broad phase.
+  struct Bvh *bvh;
+
+  // Candidate pairs kept across frames, created on first use by the verlet
+  // broad phase.
+  struct PairCache *pairCache;
 };
 typedef struct CollisionWorld CollisionWorld;
 
@@ -50,6 +237,16 @@ unsigned int CollisionWorld_getNumOfLines(CollisionWorld *collisionWorld);
 // This CollisionWorld becomes owner of the Line* line.
 void CollisionWorld_addLine(CollisionWorld *collisionWorld, Line *line);
 
+// Add n lines stored contiguously, in parallel.  Equivalent to adding each of
+// them in turn with CollisionWorld_addLine.
+void CollisionWorld_addLines(CollisionWorld *collisionWorld, Line *lines,
+                             unsigned int n);
+
+// Make the world owner of a block of lines allocated together.  Lines added
+// from the block are then freed along with it instead of one at a time.
+void CollisionWorld_setLineStorage(CollisionWorld *collisionWorld,
+                                   Line *lineStorage);
+
 // Get a line from box.
 Line *CollisionWorld_getLine(CollisionWorld *collisionWorld,
                              const unsigned int index);
@@ -63,10 +260,18 @@ void CollisionWorld_updatePosition(CollisionWorld *collisionWorld);
 // Handle line-wall collision.
 void CollisionWorld_lineWallCollision(CollisionWorld *collisionWorld);
 
+// Update position of lines and handle line-wall collision in one pass.
+void CollisionWorld_updatePositionAndWalls(CollisionWorld *collisionWorld);
+
 // Detect line-line intersection.
 void CollisionWorld_detectIntersection(CollisionWorld *collisionWorld);
 void CollisionWorld_detectIntersection_new(CollisionWorld *collisionWorld,
                                            QuadTree *q);
+void CollisionWorld_detectIntersection_grid(CollisionWorld *collisionWorld);
+void CollisionWorld_detectIntersection_sap(CollisionWorld *collisionWorld);
+void CollisionWorld_detectIntersection_morton(CollisionWorld *collisionWorld);
+void CollisionWorld_detectIntersection_bvh(CollisionWorld *collisionWorld);
+void CollisionWorld_detectIntersection_verlet(CollisionWorld *collisionWorld);
 
 // Get total number of line-wall collisions.
 unsigned int
@@ -76,6 +281,20 @@ CollisionWorld_getNumLineWallCollisions(CollisionWorld *collisionWorld);
 unsigned int
 CollisionWorld_getNumLineLineCollisions(CollisionWorld *collisionWorld);
 
+// Set both collision counters, when carrying on from a checkpoint.
+void CollisionWorld_setCollisionCounts(CollisionWorld *collisionWorld,
+                                       unsigned int lineWall,
+                                       unsigned int lineLine);
+
+// Returns a hash of every line's velocity, for checking that two runs
+// produced bit-identical results.
+uint64_t CollisionWorld_velocityHash(CollisionWorld *collisionWorld);
+
+#ifdef COLLISION_STATS
+// Print the pipeline counters summed over every frame so far.
+void CollisionWorld_printStats(CollisionWorld *collisionWorld, FILE *out);
+#endif
+
 // Update the two lines based on their intersection event.
 // Precondition: compareLines(l1, l2) < 0 must be true.
 void CollisionWorld_collisionSolver(CollisionWorld *collisionWorld, Line *l1,
@@ -83,4 +302,12 @@ void CollisionWorld_collisionSolver(CollisionWorld *collisionWorld, Line *l1,
                                     IntersectionType intersectionType);
 
 QuadTree build_quadtree(CollisionWorld *collisionWorld);
+
+// Returns a code naming the quadtree node that holds the line: a 1 bit
+// followed by the index of the child taken at every level from the root.
+// Returns 0 if the line is not in a quadtree or its node is too deep to code.
+uint64_t quadtree_placement(const Line *line);
+
+// Free every node of the quadtree along with its node pool.
+void delete_quadtree(QuadTree *q);
 #endif // COLLISIONWORLD_H_
@@ -192,6 +192,7 @@ static void graphicMainLoop(bool imageOnlyFlag) {
     checkEvent();
     drawLineSegments(display, window);
     if (!imageOnlyFlag && !LineDemo_update(gLineDemo, &gQuadTree)) {
+      delete_quadtree(&gQuadTree);
       return;
     }
   }
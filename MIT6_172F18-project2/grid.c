@@ -0,0 +1,154 @@
+/**
+ * grid.c -- uniform grid over the lines' swept bounding boxes
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./grid.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Upper bound on the number of cells per line, so that scenes of tiny lines
+// do not allocate, and clear every frame, a huge grid.
+#define GRID_CELLS_PER_LINE 4
+
+// Returns the column (or row) containing coordinate v, clamped to the grid.
+// Lines that leave the box before bouncing land in the border cells.
+static inline unsigned int cell_of(double v, double origin, double cellSize,
+                                   unsigned int dim) {
+  double c = floor((v - origin) / cellSize);
+  if (c < 0) {
+    return 0;
+  }
+  if (c >= dim) {
+    return dim - 1;
+  }
+  return (unsigned int)c;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+Grid *Grid_new(CollisionWorld *collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  Grid *grid = malloc(sizeof(Grid));
+  assert(grid);
+
+  // Size cells to the third quartile of the lines' swept extents, so that
+  // most lines cover at most four cells.
+  double *extents = malloc(sizeof(double) * (n > 0 ? n : 1));
+  assert(extents);
+  for (unsigned int i = 0; i < n; i++) {
+    double xlo, ylo, xhi, yhi;
+    Line_sweptBounds(collisionWorld->lines[i], collisionWorld->timeStep,
+                     &xlo, &ylo, &xhi, &yhi);
+    extents[i] = fmax(xhi - xlo, yhi - ylo);
+  }
+  qsort(extents, n, sizeof(double), compare_doubles);
+  double extent = n > 0 ? extents[3 * (n - 1) / 4] : 0;
+  free(extents);
+
+  double width = (double)BOX_XMAX - BOX_XMIN;
+  double height = (double)BOX_YMAX - BOX_YMIN;
+  double maxDim = ceil(sqrt(GRID_CELLS_PER_LINE * (double)n));
+  grid->cellSize = fmax(extent, fmax(width, height) / fmax(maxDim, 1));
+  grid->xmin = BOX_XMIN;
+  grid->ymin = BOX_YMIN;
+  grid->dimX = (unsigned int)fmax(ceil(width / grid->cellSize), 1);
+  grid->dimY = (unsigned int)fmax(ceil(height / grid->cellSize), 1);
+
+  unsigned int cells = grid->dimX * grid->dimY;
+  grid->cellStart = malloc(sizeof(unsigned int) * (cells + 1));
+  grid->cellFill = malloc(sizeof(unsigned int) * cells);
+  grid->cellLinesCap = 4 * (size_t)n + 1;
+  grid->cellLines = malloc(sizeof(Line *) * grid->cellLinesCap);
+  grid->x0 = malloc(sizeof(unsigned int) * (n > 0 ? n : 1));
+  grid->y0 = malloc(sizeof(unsigned int) * (n > 0 ? n : 1));
+  grid->x1 = malloc(sizeof(unsigned int) * (n > 0 ? n : 1));
+  grid->y1 = malloc(sizeof(unsigned int) * (n > 0 ? n : 1));
+  assert(grid->cellStart && grid->cellFill && grid->cellLines && grid->x0 &&
+         grid->y0 && grid->x1 && grid->y1);
+  return grid;
+}
+
+void Grid_delete(Grid *grid) {
+  if (grid == NULL) {
+    return;
+  }
+  free(grid->cellStart);
+  free(grid->cellFill);
+  free(grid->cellLines);
+  free(grid->x0);
+  free(grid->y0);
+  free(grid->x1);
+  free(grid->y1);
+  free(grid);
+}
+
+void Grid_build(Grid *grid, CollisionWorld *collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  unsigned int cells = grid->dimX * grid->dimY;
+  unsigned int *start = grid->cellStart;
+  memset(start, 0, sizeof(unsigned int) * (cells + 1));
+
+  // Find each line's cell range and count the lines of each cell.
+  for (unsigned int i = 0; i < n; i++) {
+    Line *l = collisionWorld->lines[i];
+    assert(l->id == i);
+    double xlo, ylo, xhi, yhi;
+    Line_sweptBounds(l, collisionWorld->timeStep, &xlo, &ylo, &xhi, &yhi);
+    grid->x0[i] = cell_of(xlo, grid->xmin, grid->cellSize, grid->dimX);
+    grid->x1[i] = cell_of(xhi, grid->xmin, grid->cellSize, grid->dimX);
+    grid->y0[i] = cell_of(ylo, grid->ymin, grid->cellSize, grid->dimY);
+    grid->y1[i] = cell_of(yhi, grid->ymin, grid->cellSize, grid->dimY);
+    for (unsigned int y = grid->y0[i]; y <= grid->y1[i]; y++) {
+      for (unsigned int x = grid->x0[i]; x <= grid->x1[i]; x++) {
+        start[Grid_cell(grid, x, y) + 1]++;
+      }
+    }
+  }
+
+  for (unsigned int c = 0; c < cells; c++) {
+    start[c + 1] += start[c];
+  }
+  if (start[cells] > grid->cellLinesCap) {
+    grid->cellLinesCap = 2 * (size_t)start[cells];
+    grid->cellLines =
+        realloc(grid->cellLines, sizeof(Line *) * grid->cellLinesCap);
+    assert(grid->cellLines);
+  }
+
+  // Scatter the lines into their cells, in line ID order.
+  memcpy(grid->cellFill, start, sizeof(unsigned int) * cells);
+  for (unsigned int i = 0; i < n; i++) {
+    for (unsigned int y = grid->y0[i]; y <= grid->y1[i]; y++) {
+      for (unsigned int x = grid->x0[i]; x <= grid->x1[i]; x++) {
+        grid->cellLines[grid->cellFill[Grid_cell(grid, x, y)]++] =
+            collisionWorld->lines[i];
+      }
+    }
+  }
+}
@@ -0,0 +1,72 @@
+/**
+ * grid.h -- uniform grid over the lines' swept bounding boxes
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef GRID_H_
+#define GRID_H_
+
+#include "./collision_world.h"
+#include "./line.h"
+
+// A uniform grid over the box.  Every line is listed in each cell overlapped
+// by the bounding box of the region it sweeps during one time step, so two
+// lines can only intersect if they share a cell.
+struct Grid {
+  // Lower-left corner of the grid and the side length of a cell.
+  double xmin;
+  double ymin;
+  double cellSize;
+  unsigned int dimX;
+  unsigned int dimY;
+
+  // Cell c holds the lines from cellLines[cellStart[c]] up to, but not
+  // including, cellLines[cellStart[c + 1]], in increasing line ID order.
+  // cellFill is scratch space used while binning.
+  unsigned int *cellStart;
+  unsigned int *cellFill;
+  Line **cellLines;
+  size_t cellLinesCap;
+
+  // Range of cells covered by each line, indexed by line ID.
+  unsigned int *x0;
+  unsigned int *y0;
+  unsigned int *x1;
+  unsigned int *y1;
+};
+typedef struct Grid Grid;
+
+// Create a grid sized for the lines currently in the world.  The cell size is
+// derived from the distribution of the lines' swept extents.
+Grid *Grid_new(CollisionWorld *collisionWorld);
+
+void Grid_delete(Grid *grid);
+
+// Bin every line of the world into the grid for the coming time step.
+void Grid_build(Grid *grid, CollisionWorld *collisionWorld);
+
+// Returns the index of the cell at column x, row y.
+static inline unsigned int Grid_cell(Grid *grid, unsigned int x,
+                                     unsigned int y) {
+  return y * grid->dimX + x;
+}
+
+#endif  // GRID_H_
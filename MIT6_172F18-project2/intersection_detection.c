@@ -24,12 +24,18 @@
 #include "./intersection_detection.h"
 
 #include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include "./line.h"
+#include "./simd.h"
 #include "./vec.h"
 
-// Detect if lines l1 and l2 will intersect between now and the next time step.
-IntersectionType intersect(Line *l1, Line *l2, double time) {
+#ifdef VERIFY_INTERSECT
+// The original formulation of intersect(), which the kernels below are
+// checked against.
+static IntersectionType intersect_reference(Line *l1, Line *l2, double time) {
   assert(compareLines(l1, l2) < 0);
 
   Vec p1;
@@ -95,13 +101,301 @@ IntersectionType intersect(Line *l1, Line *l2, double time) {
 
   return L1_WITH_L2;
 }
+#endif  // VERIFY_INTERSECT
+
+// Relative size below which a cross product, or a component of a vector, is
+// too close to zero for its sign to be sure to match the sign of an angle
+// computed with atan2.  atan2 and the difference of two of its results are
+// off by a few units in the last place at most, far below this.
+#define ANGLE_TOLERANCE 1e-9
+
+// Returns the sign of Vec_angle(v1, v2): 1 if the angle is positive, -1 if
+// it is negative and 0 if it is zero.  The angle is the difference of the
+// arguments of v1 and v2, which atan2 puts in (-pi, pi].  If both vectors
+// point clearly above the x axis, or both clearly below it, the difference is
+// within (-pi, pi) and has the sign of their cross product.  If one points
+// above and the other below, the difference has the sign of v1.y.  Only when
+// a vector is too near the x axis, or the two are too near parallel, is the
+// angle computed with atan2.
+static inline int angle_sign(Vec v1, Vec v2) {
+  // In double precision, so that products of single precision components
+  // are exact.
+  double x1 = v1.x, y1 = v1.y, x2 = v2.x, y2 = v2.y;
+  bool up1 = y1 > ANGLE_TOLERANCE * fabs(x1);
+  bool down1 = -y1 > ANGLE_TOLERANCE * fabs(x1);
+  bool up2 = y2 > ANGLE_TOLERANCE * fabs(x2);
+  bool down2 = -y2 > ANGLE_TOLERANCE * fabs(x2);
+  if ((up1 | down1) & (up2 | down2)) {
+    if (up1 != up2) {
+      return up1 ? 1 : -1;
+    }
+    double cross = y1 * x2 - x1 * y2;
+    double bound = ANGLE_TOLERANCE * (fabs(x1) + fabs(y1)) *
+                   (fabs(x2) + fabs(y2));
+    if (fabs(cross) > bound) {
+      return cross > 0 ? 1 : -1;
+    }
+  }
+  double angle = Vec_angle(v1, v2);
+  return (angle > 0) - (angle < 0);
+}
+
+// Finish the classification of intersect() for one pair, given which of its
+// tests passed.
+static inline IntersectionType classify(Line *l1, Line *l2, bool already,
+                                        bool moved, bool top, bool bottom,
+                                        bool inside) {
+  if (already) {
+    return ALREADY_INTERSECTED;
+  }
+  int num_line_intersections = moved + top + bottom;
+  if (num_line_intersections == 2) {
+    return L2_WITH_L1;
+  }
+  if (inside) {
+    return L1_WITH_L2;
+  }
+  if (num_line_intersections == 0) {
+    return NO_INTERSECTION;
+  }
+
+  // Only reached by a small fraction of pairs.
+  int angle = angle_sign(Vec_makeFromLine(*l1), Vec_makeFromLine(*l2));
+  if (top) {
+    return angle < 0 ? L2_WITH_L1 : L1_WITH_L2;
+  }
+  if (bottom) {
+    return angle > 0 ? L2_WITH_L1 : L1_WITH_L2;
+  }
+  return L1_WITH_L2;
+}
+
+// Whether a and b have strictly opposite signs.
+static inline bool straddle(vec_dimension a, vec_dimension b) {
+  return ((a > 0) & (b < 0)) | ((a < 0) & (b > 0));
+}
+
+// Detect if lines l1 and l2 will intersect between now and the next time step.
+//
+// The four intersectLines() tests and the two pointInParallelogram() tests
+// of the original formulation take 24 cross products between them, but only
+// 16 are distinct: the sides of l1 that each corner of the parallelogram is
+// on, and the sides of each edge of the parallelogram that each endpoint of
+// l1 is on.  Each is computed once here, by direction() with the same
+// arguments as there, so it rounds the same way and the results are exactly
+// those of the original.  The tests are then combined without short circuits.
+IntersectionType intersect(Line *l1, Line *l2, double time) {
+  assert(compareLines(l1, l2) < 0);
+
+  Vec a1 = l1->p1;
+  Vec a2 = l1->p2;
+  Vec b1 = l2->p1;
+  Vec b2 = l2->p2;
+
+  // Get relative velocity, then the parallelogram.  The arithmetic of
+  // Vec_subtract, Vec_multiply and Vec_add is written out, so that the calls
+  // do not force every value into memory.
+  Vec velocity = {.x = l2->velocity.x - l1->velocity.x,
+                  .y = l2->velocity.y - l1->velocity.y};
+  Vec step = {.x = velocity.x * time, .y = velocity.y * time};
+  Vec p1 = {.x = b1.x + step.x, .y = b1.y + step.y};
+  Vec p2 = {.x = b2.x + step.x, .y = b2.y + step.y};
+
+  // Sides of l1 that the corners are on.
+  vec_dimension sb1 = direction(a1, a2, b1);
+  vec_dimension sb2 = direction(a1, a2, b2);
+  vec_dimension sp1 = direction(a1, a2, p1);
+  vec_dimension sp2 = direction(a1, a2, p2);
+  bool zero = (sb1 == 0) | (sb2 == 0) | (sp1 == 0) | (sp2 == 0);
+
+  // Sides of each edge that a1 and a2 are on, each folded into the tests as
+  // soon as it is computed.  The edges from l2 to its moved copy are taken in
+  // both directions, as the original tests do.
+  vec_dimension d1 = direction(b1, b2, a1);
+  vec_dimension d2 = direction(b1, b2, a2);
+  vec_dimension e1 = direction(p1, p2, a1);
+  vec_dimension e2 = direction(p1, p2, a2);
+  bool already = straddle(d1, d2) & straddle(sb1, sb2);
+  bool moved = straddle(e1, e2) & straddle(sp1, sp2);
+  bool inside = straddle(d1, e1) & straddle(d2, e2);
+  zero |= (d1 == 0) | (d2 == 0) | (e1 == 0) | (e2 == 0);
+
+  d1 = direction(p1, b1, a1);
+  d2 = direction(p1, b1, a2);
+  e1 = direction(p2, b2, a1);
+  e2 = direction(p2, b2, a2);
+  bool top = straddle(d1, d2) & straddle(sp1, sb1);
+  bool bottom = straddle(e1, e2) & straddle(sp2, sb2);
+  zero |= (d1 == 0) | (d2 == 0) | (e1 == 0) | (e2 == 0);
+
+  d1 = direction(b1, p1, a1);
+  d2 = direction(b1, p1, a2);
+  e1 = direction(b2, p2, a1);
+  e2 = direction(b2, p2, a2);
+  inside &= straddle(d1, e1) & straddle(d2, e2);
+
+  // A side of exactly zero puts an endpoint on the line through an edge,
+  // where intersectLines() also checks whether it lies on the edge itself.
+  // That is rare, so the original tests are simply rerun.
+  if (zero) {
+    already = intersectLines(a1, a2, b1, b2);
+    moved = intersectLines(a1, a2, p1, p2);
+    top = intersectLines(a1, a2, p1, b1);
+    bottom = intersectLines(a1, a2, p2, b2);
+  }
+  return classify(l1, l2, already, moved, top, bottom, inside);
+}
+
+#ifdef HAVE_SIMD
+// A two-dimensional vector per lane.
+typedef struct {
+  vreal x;
+  vreal y;
+} VecN;
+
+// Lane-wise direction(); performs the same operations in the same order.
+static inline vreal directionN(VecN pi, VecN pj, VecN pk) {
+  return vsub(vmul(vsub(pk.x, pi.x), vsub(pj.y, pi.y)),
+              vmul(vsub(pj.x, pi.x), vsub(pk.y, pi.y)));
+}
+
+// Lane-wise onSegment().
+static inline vreal onSegmentN(VecN pi, VecN pj, VecN pk) {
+  vreal in_x = vor(vand(vle(pi.x, pk.x), vle(pk.x, pj.x)),
+                   vand(vle(pj.x, pk.x), vle(pk.x, pi.x)));
+  vreal in_y = vor(vand(vle(pi.y, pk.y), vle(pk.y, pj.y)),
+                   vand(vle(pj.y, pk.y), vle(pk.y, pi.y)));
+  return vand(in_x, in_y);
+}
+
+// Lanes where a and b have strictly opposite signs.
+static inline vreal straddleN(vreal a, vreal b) {
+  vreal zero = vset1(0);
+  return vor(vand(vgt(a, zero), vlt(b, zero)),
+             vand(vlt(a, zero), vgt(b, zero)));
+}
+
+// Lane-wise intersectLines().
+static inline vreal intersectLinesN(VecN p1, VecN p2, VecN p3, VecN p4) {
+  vreal zero = vset1(0);
+  vreal d1 = directionN(p3, p4, p1);
+  vreal d2 = directionN(p3, p4, p2);
+  vreal d3 = directionN(p1, p2, p3);
+  vreal d4 = directionN(p1, p2, p4);
+
+  vreal hit = vand(straddleN(d1, d2), straddleN(d3, d4));
+  hit = vor(hit, vand(veq(d1, zero), onSegmentN(p3, p4, p1)));
+  hit = vor(hit, vand(veq(d2, zero), onSegmentN(p3, p4, p2)));
+  hit = vor(hit, vand(veq(d3, zero), onSegmentN(p1, p2, p3)));
+  hit = vor(hit, vand(veq(d4, zero), onSegmentN(p1, p2, p4)));
+  return hit;
+}
+
+// Lane-wise pointInParallelogram().
+static inline vreal pointInParallelogramN(VecN point, VecN p1, VecN p2,
+                                          VecN p3, VecN p4) {
+  vreal d1 = directionN(p1, p2, point);
+  vreal d2 = directionN(p3, p4, point);
+  vreal d3 = directionN(p1, p3, point);
+  vreal d4 = directionN(p2, p4, point);
+  return vand(straddleN(d1, d2), straddleN(d3, d4));
+}
+
+// intersect() for VLANES pairs at once.  l1[k] and l2[k] must satisfy
+// compareLines(l1[k], l2[k]) < 0.
+static void intersectN(Line **l1, Line **l2, double time,
+                       IntersectionType *out) {
+  vec_dimension buf[12][VLANES] __attribute__((aligned(32)));
+  for (int k = 0; k < VLANES; k++) {
+    buf[0][k] = l1[k]->p1.x;
+    buf[1][k] = l1[k]->p1.y;
+    buf[2][k] = l1[k]->p2.x;
+    buf[3][k] = l1[k]->p2.y;
+    buf[4][k] = l2[k]->p1.x;
+    buf[5][k] = l2[k]->p1.y;
+    buf[6][k] = l2[k]->p2.x;
+    buf[7][k] = l2[k]->p2.y;
+    buf[8][k] = l1[k]->velocity.x;
+    buf[9][k] = l1[k]->velocity.y;
+    buf[10][k] = l2[k]->velocity.x;
+    buf[11][k] = l2[k]->velocity.y;
+  }
+  VecN a1 = {vload(buf[0]), vload(buf[1])};
+  VecN a2 = {vload(buf[2]), vload(buf[3])};
+  VecN b1 = {vload(buf[4]), vload(buf[5])};
+  VecN b2 = {vload(buf[6]), vload(buf[7])};
+
+  // Get relative velocity, then the parallelogram.
+  vreal t = vset1(time);
+  VecN velocity = {vsub(vload(buf[10]), vload(buf[8])),
+                   vsub(vload(buf[11]), vload(buf[9]))};
+  VecN p1 = {vadd(b1.x, vmul(velocity.x, t)), vadd(b1.y, vmul(velocity.y, t))};
+  VecN p2 = {vadd(b2.x, vmul(velocity.x, t)), vadd(b2.y, vmul(velocity.y, t))};
+
+  unsigned int already = vmovemask(intersectLinesN(a1, a2, b1, b2));
+  unsigned int moved = vmovemask(intersectLinesN(a1, a2, p1, p2));
+  unsigned int top = vmovemask(intersectLinesN(a1, a2, p1, b1));
+  unsigned int bottom = vmovemask(intersectLinesN(a1, a2, p2, b2));
+  unsigned int inside =
+      vmovemask(vand(pointInParallelogramN(a1, b1, b2, p1, p2),
+                     pointInParallelogramN(a2, b1, b2, p1, p2)));
+
+  for (int k = 0; k < VLANES; k++) {
+    out[k] = classify(l1[k], l2[k], (already >> k) & 1, (moved >> k) & 1,
+                      (top >> k) & 1, (bottom >> k) & 1, (inside >> k) & 1);
+  }
+}
+#endif  // HAVE_SIMD
+
+#ifdef VERIFY_INTERSECT
+// Abort unless got is what the original formulation gives for the pair.
+static void verify(Line *l1, Line *l2, double time, IntersectionType got) {
+  IntersectionType expected = intersect_reference(l1, l2, time);
+  if (got != expected) {
+    fprintf(stderr, "intersect_batch: lines %u and %u gave %d, not %d\n",
+            l1->id, l2->id, got, expected);
+    abort();
+  }
+}
+#endif
+
+void intersect_batch(Line *l1, Line **others, unsigned int n, double time,
+                     IntersectionType *out) {
+  unsigned int k = 0;
+#ifdef HAVE_SIMD
+  for (; k + VLANES <= n; k += VLANES) {
+    Line *first[VLANES];
+    Line *second[VLANES];
+    for (int i = 0; i < VLANES; i++) {
+      bool before = compareLines(l1, others[k + i]) < 0;
+      first[i] = before ? l1 : others[k + i];
+      second[i] = before ? others[k + i] : l1;
+    }
+    intersectN(first, second, time, &out[k]);
+#ifdef VERIFY_INTERSECT
+    for (int i = 0; i < VLANES; i++) {
+      verify(first[i], second[i], time, out[k + i]);
+    }
+#endif
+  }
+#endif
+  for (; k < n; k++) {
+    bool before = compareLines(l1, others[k]) < 0;
+    Line *first = before ? l1 : others[k];
+    Line *second = before ? others[k] : l1;
+    out[k] = intersect(first, second, time);
+#ifdef VERIFY_INTERSECT
+    verify(first, second, time, out[k]);
+#endif
+  }
+}
 
 // Check if a point is in the parallelogram.
 bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4) {
-  double d1 = direction(p1, p2, point);
-  double d2 = direction(p3, p4, point);
-  double d3 = direction(p1, p3, point);
-  double d4 = direction(p2, p4, point);
+  vec_dimension d1 = direction(p1, p2, point);
+  vec_dimension d2 = direction(p3, p4, point);
+  vec_dimension d3 = direction(p1, p3, point);
+  vec_dimension d4 = direction(p2, p4, point);
 
   if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
       ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
@@ -113,10 +407,10 @@ bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4) {
 // Check if two lines intersect.
 bool intersectLines(Vec p1, Vec p2, Vec p3, Vec p4) {
   // Relative orientation
-  double d1 = direction(p3, p4, p1);
-  double d2 = direction(p3, p4, p2);
-  double d3 = direction(p1, p2, p3);
-  double d4 = direction(p1, p2, p4);
+  vec_dimension d1 = direction(p3, p4, p1);
+  vec_dimension d2 = direction(p3, p4, p2);
+  vec_dimension d3 = direction(p1, p2, p3);
+  vec_dimension d4 = direction(p1, p2, p4);
 
   // If (p1, p2) and (p3, p4) straddle each other, the line segments must
   // intersect.
@@ -150,7 +444,7 @@ Vec getIntersectionPoint(Vec p1, Vec p2, Vec p3, Vec p4) {
 }
 
 // Check the direction of two lines (pi, pj) and (pi, pk).
-double direction(Vec pi, Vec pj, Vec pk) {
+vec_dimension direction(Vec pi, Vec pj, Vec pk) {
   return crossProduct(pk.x - pi.x, pk.y - pi.y, pj.x - pi.x, pj.y - pi.y);
 }
 
@@ -165,6 +459,7 @@ bool onSegment(Vec pi, Vec pj, Vec pk) {
 }
 
 // Calculate the cross product.
-double crossProduct(double x1, double y1, double x2, double y2) {
+vec_dimension crossProduct(vec_dimension x1, vec_dimension y1,
+                           vec_dimension x2, vec_dimension y2) {
   return x1 * y2 - x2 * y1;
 }
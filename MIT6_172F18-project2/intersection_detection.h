@@ -37,6 +37,13 @@ typedef enum {
 // Precondition: compareLines(l1, l2) < 0 must be true.
 IntersectionType intersect(Line *l1, Line *l2, double time);
 
+// Detect whether l1 will intersect each of the n lines in others.  Each pair
+// is ordered by line ID before testing, as callers of intersect() must do, and
+// out[k] receives the result for others[k].  Full groups of candidates are
+// tested together with vector instructions when available.
+void intersect_batch(Line *l1, Line **others, unsigned int n, double time,
+                     IntersectionType *out);
+
 // Check if a point is in the parallelogram.
 bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4);
 
@@ -44,13 +51,14 @@ bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4);
 bool intersectLines(Vec p1, Vec p2, Vec p3, Vec p4);
 
 // Check the direction of two lines (pi, pj) and (pi, pk).
-double direction(Vec pi, Vec pj, Vec pk);
+vec_dimension direction(Vec pi, Vec pj, Vec pk);
 
 // Check if a point pk is in the line segment (pi, pj).
 bool onSegment(Vec pi, Vec pj, Vec pk);
 
 // Calculate the cross product.
-double crossProduct(double x1, double y1, double x2, double y2);
+vec_dimension crossProduct(vec_dimension x1, vec_dimension y1,
+                           vec_dimension x2, vec_dimension y2);
 
 // Obtain the intersection point for two intersecting line segments.
 Vec getIntersectionPoint(Vec p1, Vec p2, Vec p3, Vec p4);
@@ -24,81 +24,134 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
-int IntersectionEventNode_compareData(IntersectionEventNode* node1,
-                                      IntersectionEventNode* node2) {
-  if (compareLines(node1->l1, node2->l1) < 0) {
-    return -1;
-  } else if (compareLines(node1->l1, node2->l1) == 0) {
-    if (compareLines(node1->l2, node2->l2) < 0) {
-      return -1;
-    } else if (compareLines(node1->l2, node2->l2) == 0) {
-      return 0;
-    } else {
-      return 1;
-    }
-  } else {
-    return 1;
+IntersectionEventList IntersectionEventList_make() {
+  IntersectionEventList intersectionEventList;
+  intersectionEventList.events = NULL;
+  intersectionEventList.len = 0;
+  intersectionEventList.cap = 0;
+  return intersectionEventList;
+}
+
+// Grows the list so that it can hold at least cap events.
+static void IntersectionEventList_reserve(
+    IntersectionEventList* intersectionEventList, size_t cap) {
+  if (cap <= intersectionEventList->cap) {
+    return;
+  }
+  size_t newCap =
+      intersectionEventList->cap == 0 ? 64 : 2 * intersectionEventList->cap;
+  if (newCap < cap) {
+    newCap = cap;
   }
+  intersectionEventList->events = realloc(intersectionEventList->events,
+                                          newCap * sizeof(IntersectionEvent));
+  assert(intersectionEventList->events);
+  intersectionEventList->cap = newCap;
 }
 
-void IntersectionEventNode_swapData(IntersectionEventNode* node1,
-                                    IntersectionEventNode* node2) {
-  {
-    Line* temp = node1->l1;
-    node1->l1 = node2->l1;
-    node2->l1 = temp;
+void IntersectionEventList_append(IntersectionEventList* intersectionEventList,
+                                  Line* l1, Line* l2,
+                                  IntersectionType intersectionType) {
+  assert(compareLines(l1, l2) < 0);
+
+  if (intersectionEventList->len == intersectionEventList->cap) {
+    IntersectionEventList_reserve(intersectionEventList,
+                                  intersectionEventList->len + 1);
   }
-  {
-    Line* temp = node1->l2;
-    node1->l2 = node2->l2;
-    node2->l2 = temp;
+  IntersectionEvent* event =
+      &intersectionEventList->events[intersectionEventList->len++];
+  event->key = ((uint64_t)l1->id << 32) | l2->id;
+  event->l1 = l1;
+  event->l2 = l2;
+  event->intersectionType = intersectionType;
+}
+
+void IntersectionEventList_concat(IntersectionEventList* dst,
+                                  IntersectionEventList* src) {
+  if (src->len == 0) {
+    return;
   }
-  {
-    IntersectionType temp = node1->intersectionType;
-    node1->intersectionType = node2->intersectionType;
-    node2->intersectionType = temp;
+  if (dst->len == 0 && dst->cap <= src->cap) {
+    IntersectionEventList temp = *dst;
+    *dst = *src;
+    *src = temp;
+    return;
   }
+  IntersectionEventList_reserve(dst, dst->len + src->len);
+  memcpy(&dst->events[dst->len], src->events,
+         src->len * sizeof(IntersectionEvent));
+  dst->len += src->len;
+  src->len = 0;
 }
 
-IntersectionEventList IntersectionEventList_make() {
-  IntersectionEventList intersectionEventList;
-  intersectionEventList.head = NULL;
-  intersectionEventList.tail = NULL;
-  return intersectionEventList;
+void IntersectionEventList_clear(IntersectionEventList* intersectionEventList) {
+  intersectionEventList->len = 0;
 }
 
-void IntersectionEventList_appendNode(
-    IntersectionEventList* intersectionEventList, Line* l1, Line* l2,
-    IntersectionType intersectionType) {
-  assert(compareLines(l1, l2) < 0);
+void IntersectionEventList_free(IntersectionEventList* intersectionEventList) {
+  free(intersectionEventList->events);
+  *intersectionEventList = IntersectionEventList_make();
+}
 
-  IntersectionEventNode* newNode = malloc(sizeof(IntersectionEventNode));
-  if (newNode == NULL) {
+// Digit width of the radix sort.
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+void IntersectionEventList_sort(IntersectionEventList* intersectionEventList,
+                                IntersectionEventList* scratch) {
+  size_t n = intersectionEventList->len;
+  IntersectionEvent* events = intersectionEventList->events;
+  if (n < 2) {
     return;
   }
+  IntersectionEventList_reserve(scratch, n);
 
-  newNode->l1 = l1;
-  newNode->l2 = l2;
-  newNode->intersectionType = intersectionType;
-  newNode->next = NULL;
-  if (intersectionEventList->head == NULL) {
-    intersectionEventList->head = newNode;
-  } else {
-    intersectionEventList->tail->next = newNode;
+  // Histogram every digit in a single pass over the keys.
+  size_t counts[RADIX_PASSES][RADIX_BUCKETS];
+  memset(counts, 0, sizeof(counts));
+  for (size_t i = 0; i < n; i++) {
+    uint64_t key = events[i].key;
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+      counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+  }
+
+  IntersectionEvent* src = events;
+  IntersectionEvent* dst = scratch->events;
+  for (int pass = 0; pass < RADIX_PASSES; pass++) {
+    int shift = pass * RADIX_BITS;
+    size_t* count = counts[pass];
+
+    // Line IDs rarely use all 32 bits, so most digits are the same for every
+    // key.  Such a pass would not move anything.
+    if (count[(src[0].key >> shift) & (RADIX_BUCKETS - 1)] == n) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (int b = 0; b < RADIX_BUCKETS; b++) {
+      size_t c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+    for (size_t i = 0; i < n; i++) {
+      dst[count[(src[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+    }
+    IntersectionEvent* temp = src;
+    src = dst;
+    dst = temp;
   }
-  intersectionEventList->tail = newNode;
-}
 
-void IntersectionEventList_deleteNodes(
-    IntersectionEventList* intersectionEventList) {
-  IntersectionEventNode* curNode = intersectionEventList->head;
-  IntersectionEventNode* nextNode = NULL;
-  while (curNode != NULL) {
-    nextNode = curNode->next;
-    free(curNode);
-    curNode = nextNode;
+  // An odd number of passes leaves the result in the scratch buffer; trade
+  // storage with it rather than copying back.
+  if (src != events) {
+    IntersectionEventList temp = *intersectionEventList;
+    intersectionEventList->events = scratch->events;
+    intersectionEventList->cap = scratch->cap;
+    scratch->events = temp.events;
+    scratch->cap = temp.cap;
   }
-  intersectionEventList->head = NULL;
-  intersectionEventList->tail = NULL;
 }
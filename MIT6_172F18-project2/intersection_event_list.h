@@ -23,46 +23,57 @@
 #ifndef INTERSECTIONEVENTLIST_H_
 #define INTERSECTIONEVENTLIST_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "./line.h"
 #include "./intersection_detection.h"
 
-struct IntersectionEventNode {
-  // This IntersectionEventNode does not own these Line* lines.
+// An intersection event stored by value, so that a frame's events can be
+// sorted and solved from one contiguous array.
+struct IntersectionEvent {
+  // Sort key: l1's line ID in the high 32 bits, l2's in the low 32 bits.
+  uint64_t key;
+  // This IntersectionEvent does not own these Line* lines.
   Line* l1;
   Line* l2;
   IntersectionType intersectionType;
-  struct IntersectionEventNode* next;
 };
-typedef struct IntersectionEventNode IntersectionEventNode;
-
-// Compares the nodes by l1's line ID, then l1's line ID.
-// -1 <=> node1 ordered before node2
-//  0 <=> node1 ordered the same as node2
-//  1 <=> node1 ordered after node2
-int IntersectionEventNode_compareData(IntersectionEventNode* node1,
-                                      IntersectionEventNode* node2);
-
-// Swaps the node1's and node2's data (l1, l2, intersectionType).
-void IntersectionEventNode_swapData(IntersectionEventNode* node1,
-                                    IntersectionEventNode* node2);
+typedef struct IntersectionEvent IntersectionEvent;
 
+// A growable array of intersection events.  Clearing a list keeps its
+// storage, so a list that is reused every frame stops allocating once it has
+// grown to the largest number of events seen in a frame.
 struct IntersectionEventList {
-  IntersectionEventNode* head;
-  IntersectionEventNode* tail;
+  IntersectionEvent* events;
+  size_t len;
+  size_t cap;
 };
 typedef struct IntersectionEventList IntersectionEventList;
 
-// Returns an empty list.
+// Returns an empty list.  No storage is allocated until the first append.
 IntersectionEventList IntersectionEventList_make();
 
-// Appends a new node to the list with the data (l1, l2, intersectionType).
+// Appends a new event to the list with the data (l1, l2, intersectionType).
 // Precondition: compareLines(l1, l2) < 0 must be true.
-void IntersectionEventList_appendNode(
-    IntersectionEventList* intersectionEventList, Line* l1, Line* l2,
-    IntersectionType intersectionType);
+void IntersectionEventList_append(IntersectionEventList* intersectionEventList,
+                                  Line* l1, Line* l2,
+                                  IntersectionType intersectionType);
+
+// Moves all the events of src to the end of dst, leaving src empty.  If dst
+// is empty the two lists simply trade storage.
+void IntersectionEventList_concat(IntersectionEventList* dst,
+                                  IntersectionEventList* src);
+
+// Removes all the events in the list, keeping its storage.
+void IntersectionEventList_clear(IntersectionEventList* intersectionEventList);
+
+// Frees the list's storage.
+void IntersectionEventList_free(IntersectionEventList* intersectionEventList);
 
-// Deletes all the nodes in the list.
-void IntersectionEventList_deleteNodes(
-    IntersectionEventList* intersectionEventList);
+// Sorts the events by l1's line ID, then l2's line ID, with an LSD radix sort.
+// scratch is grown as needed and can be reused across calls.
+void IntersectionEventList_sort(IntersectionEventList* intersectionEventList,
+                                IntersectionEventList* scratch);
 
 #endif  // INTERSECTIONEVENTLIST_H_
@@ -26,6 +26,7 @@
 
 #include "./graphic_stuff.h"
 #include "./vec.h"
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -48,6 +49,14 @@ typedef vec_dimension box_dimension;
 // The allowable colors for a line.
 typedef enum { RED = 0, GRAY = 1 } Color;
 
+// A quadtree leaf is split once it holds more than R_PARAM lines.
+#define R_PARAM 3
+
+// A subtree is collapsed back into its root once it holds at most this many
+// lines.  Keeping it below R_PARAM stops a node from splitting and merging on
+// alternate frames.
+#define COLLAPSE_PARAM (R_PARAM / 2)
+
 typedef struct {
   size_t len;
   size_t cap;
@@ -55,12 +64,36 @@ typedef struct {
 } Lines;
 
 typedef struct Node {
-  struct Node **children;
+  // The four children of this node, stored contiguously, or NULL for a leaf.
+  struct Node *children;
   struct Node *parent;
   Vec bl, tl, br, tr;
-  Lines *lines;
+  Lines lines;
+  // Pairs of lines tested in this node's subtree: each node's lines against
+  // each other and against the lines of all of its ancestors.  Refreshed by
+  // every update of the tree.
+  size_t work;
+  // Inline storage backing lines until the node holds more than a leaf can.
+  struct Line *bucket[R_PARAM + 1];
 } Node;
 
+// Number of child blocks (four Nodes each) carved out of one slab.
+#define NODE_SLAB_BLOCKS 256
+
+// Slab allocator for quadtree nodes.  Nodes are handed out and recycled four
+// at a time, as the children of one split.
+typedef struct {
+  // Every slab allocated so far, so they can be freed with the tree.
+  Node **slabs;
+  size_t numSlabs;
+  size_t slabCap;
+  // Unused blocks remaining in the newest slab.
+  Node *next;
+  size_t remaining;
+  // Recycled blocks, chained through the first node's parent pointer.
+  Node *freeBlocks;
+} NodePool;
+
 // A two-dimensional line.
 struct Line {
   Vec p1; // One endpoint of the line.
@@ -87,9 +120,19 @@ typedef struct {
   Node **nodes;
 } NodeQueue;
 
+// Work done maintaining the quadtree, summed over every update.
+typedef struct {
+  size_t updates;
+  size_t linesMoved;
+  size_t splits;
+  size_t merges;
+} QuadTreeStats;
+
 typedef struct {
   Node *root;
   NodeQueue *leaves;
+  NodePool pool;
+  QuadTreeStats stats;
 } QuadTree;
 
 // Compares the lines by line ID.
@@ -106,6 +149,28 @@ static inline int compareLines(Line *line1, Line *line2) {
   }
 }
 
+// Swept boxes are padded by this much so that rounding in intersect()'s own
+// parallelogram cannot carry a point outside the box.
+#ifdef VEC_FLOAT
+#define SWEPT_BOUNDS_PAD 1e-6
+#else
+#define SWEPT_BOUNDS_PAD 1e-9
+#endif
+
+// Bounding box of the region the line sweeps during the next time step.
+// This uses the line's current velocity: p3 and p4 keep the velocity the line
+// was loaded with, so they do not bound the motion after a collision.  Two
+// lines can only collide if these boxes overlap.
+static inline void Line_sweptBounds(Line *l, double t, double *xlo,
+                                    double *ylo, double *xhi, double *yhi) {
+  double dx = l->velocity.x * t;
+  double dy = l->velocity.y * t;
+  *xlo = fmin(l->p1.x, l->p2.x) + fmin(dx, 0) - SWEPT_BOUNDS_PAD;
+  *xhi = fmax(l->p1.x, l->p2.x) + fmax(dx, 0) + SWEPT_BOUNDS_PAD;
+  *ylo = fmin(l->p1.y, l->p2.y) + fmin(dy, 0) - SWEPT_BOUNDS_PAD;
+  *yhi = fmax(l->p1.y, l->p2.y) + fmax(dy, 0) + SWEPT_BOUNDS_PAD;
+}
+
 // Convert graphical window coordinates to box coordinates.
 static inline void windowToBox(box_dimension *xout, box_dimension *yout,
                                window_dimension x, window_dimension y) {
@@ -137,6 +202,31 @@ static inline void add_line(Lines *lines, Line *l) {
   lines->len++;
 }
 
+// Point a node's lines at its inline bucket.
+static inline void node_init_lines(Node *n) {
+  n->lines.len = 0;
+  n->lines.cap = R_PARAM + 1;
+  n->lines.lines = n->bucket;
+}
+
+// Add a line to a node, moving its lines to the heap if the bucket is full.
+static inline void node_add_line(Node *n, Line *l) {
+  if (n->lines.len + 1 > n->lines.cap && n->lines.lines == n->bucket) {
+    n->lines.cap *= 2;
+    n->lines.lines = malloc(sizeof(Line *) * n->lines.cap);
+    memcpy(n->lines.lines, n->bucket, sizeof(Line *) * n->lines.len);
+  }
+  add_line(&n->lines, l);
+}
+
+// Free a node's lines if they outgrew the inline bucket.
+static inline void node_release_lines(Node *n) {
+  if (n->lines.lines != n->bucket) {
+    free(n->lines.lines);
+  }
+  node_init_lines(n);
+}
+
 static inline void deinit_lines(Lines *l) {
   if (l == NULL)
     return;
@@ -24,21 +24,74 @@
 #include "./line_demo.h"
 
 #include <assert.h>
+#include <cilk/cilk.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 
+#include "./checkpoint.h"
 #include "./graphic_stuff.h"
 #include "./line.h"
+#include "./scene.h"
 #include "collision_world.h"
 #include "vec.h"
 
 static char *LineDemo_input_file_path;
+static BroadPhase LineDemo_broad_phase = BROAD_PHASE_QUADTREE;
+static unsigned int LineDemo_grain_size = DEFAULT_GRAIN_SIZE;
+static size_t LineDemo_spawn_cutoff = DEFAULT_SPAWN_CUTOFF;
+static char *LineDemo_checkpoint_path;
+static unsigned int LineDemo_checkpoint_interval;
+static char *LineDemo_record_path;
+static bool LineDemo_record_delta;
+static unsigned int LineDemo_record_slots = RECORDER_DEFAULT_SLOTS;
+#ifdef COLLISION_STATS
+static char *LineDemo_stats_dump_path;
+#endif
 
 void LineDemo_setInputFile(char *input_file_path) {
   LineDemo_input_file_path = input_file_path;
 }
 
+void LineDemo_setBroadPhase(BroadPhase broadPhase) {
+  LineDemo_broad_phase = broadPhase;
+}
+
+void LineDemo_setGrainSize(unsigned int grainSize) {
+  LineDemo_grain_size = grainSize;
+}
+
+void LineDemo_setSpawnCutoff(size_t spawnCutoff) {
+  LineDemo_spawn_cutoff = spawnCutoff;
+}
+
+void LineDemo_setCheckpointFile(char *checkpoint_path, unsigned int interval) {
+  LineDemo_checkpoint_path = checkpoint_path;
+  LineDemo_checkpoint_interval = interval;
+}
+
+void LineDemo_setRecordFile(char *record_path, bool delta) {
+  LineDemo_record_path = record_path;
+  LineDemo_record_delta = delta;
+}
+
+void LineDemo_setRecordSlots(unsigned int slots) {
+  LineDemo_record_slots = slots;
+}
+
+#ifdef COLLISION_STATS
+void LineDemo_setStatsDumpFile(char *stats_dump_path) {
+  LineDemo_stats_dump_path = stats_dump_path;
+}
+
+void LineDemo_printStats(LineDemo *lineDemo) {
+  CollisionWorld_printStats(lineDemo->collisionWorld, stdout);
+}
+#endif
+
 LineDemo *LineDemo_new() {
   LineDemo *lineDemo = malloc(sizeof(LineDemo));
   if (lineDemo == NULL) {
@@ -48,15 +101,230 @@ LineDemo *LineDemo_new() {
   lineDemo->count = 0;
   lineDemo->numFrames = 0;
   lineDemo->collisionWorld = NULL;
+  lineDemo->recorder = NULL;
   return lineDemo;
 }
 
 void LineDemo_delete(LineDemo *lineDemo) {
+  if (lineDemo->recorder != NULL) {
+    Recorder_delete(lineDemo->recorder);
+  }
+#ifdef COLLISION_STATS
+  if (lineDemo->collisionWorld->statsDump != NULL) {
+    fclose(lineDemo->collisionWorld->statsDump);
+  }
+#endif
   CollisionWorld_delete(lineDemo->collisionWorld);
   free(lineDemo);
 }
 
-// Read in lines from line.in and add them into collision world for simulation.
+// Set up a line from its window coordinates and velocity.
+static void init_line(Line *line, unsigned int id, double timeStep,
+                      window_dimension px1, window_dimension py1,
+                      window_dimension px2, window_dimension py2,
+                      window_dimension vx, window_dimension vy, int isGray) {
+  // convert window coordinates to box coordinates
+  windowToBox(&line->p1.x, &line->p1.y, px1, py1);
+  windowToBox(&line->p2.x, &line->p2.y, px2, py2);
+
+  line->length = Vec_length(Vec_subtract(line->p1, line->p2));
+
+  // convert window velocity to box velocity
+  velocityWindowToBox(&line->velocity.x, &line->velocity.y, vx, vy);
+
+  line->p3 = Vec_add(line->p1, Vec_multiply(line->velocity, timeStep));
+  line->p4 = Vec_add(line->p2, Vec_multiply(line->velocity, timeStep));
+
+  // store color
+  line->color = (Color)isGray;
+
+  // store line ID
+  line->id = id;
+  line->quad_tree_node = NULL;
+}
+
+// Create the collision world for numOfLines lines, along with one block of
+// storage for all of them.
+static Line *new_world(LineDemo *lineDemo, unsigned int numOfLines) {
+  lineDemo->collisionWorld = CollisionWorld_new(numOfLines);
+  lineDemo->collisionWorld->broadPhase = LineDemo_broad_phase;
+  lineDemo->collisionWorld->grainSize = LineDemo_grain_size;
+  lineDemo->collisionWorld->spawnCutoff = LineDemo_spawn_cutoff;
+#ifdef COLLISION_STATS
+  if (LineDemo_stats_dump_path != NULL) {
+    lineDemo->collisionWorld->statsDump = fopen(LineDemo_stats_dump_path, "w");
+    if (lineDemo->collisionWorld->statsDump == NULL) {
+      fprintf(stderr, "Cannot write stats to %s\n", LineDemo_stats_dump_path);
+      exit(1);
+    }
+  }
+#endif
+
+  Line *lines = malloc(numOfLines * sizeof(Line));
+  if (lines == NULL) {
+    fprintf(stderr, "Cannot allocate %u lines\n", numOfLines);
+    exit(1);
+  }
+  CollisionWorld_setLineStorage(lineDemo->collisionWorld, lines);
+  return lines;
+}
+
+// Map a binary scene and convert its records straight into line storage.
+static void LineDemo_loadBinaryLines(LineDemo *lineDemo, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(SceneHeader)) {
+    fprintf(stderr, "Truncated scene (%s)\n", LineDemo_input_file_path);
+    exit(1);
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Cannot map scene (%s)\n", LineDemo_input_file_path);
+    exit(1);
+  }
+  const SceneHeader *header = map;
+  const SceneRecord *records = (const SceneRecord *)(header + 1);
+  unsigned int numOfLines = header->numOfLines;
+  if (header->version != SCENE_VERSION || numOfLines == 0 ||
+      (st.st_size - sizeof(SceneHeader)) / sizeof(SceneRecord) <
+          numOfLines) {
+    fprintf(stderr, "Bad scene header (%s)\n", LineDemo_input_file_path);
+    exit(1);
+  }
+
+  Line *lines = new_world(lineDemo, numOfLines);
+  double timeStep = lineDemo->collisionWorld->timeStep;
+  cilk_for (unsigned int i = 0; i < numOfLines; i++) {
+    const SceneRecord *r = &records[i];
+    init_line(&lines[i], i, timeStep, r->p1x, r->p1y, r->p2x, r->p2y, r->vx,
+              r->vy, r->isGray);
+  }
+  munmap(map, st.st_size);
+
+  // transfer ownership of lines to collisionWorld
+  CollisionWorld_addLines(lineDemo->collisionWorld, lines, numOfLines);
+}
+
+static void zero_count(void *view) { *(unsigned int *)view = 0; }
+
+static void add_count(void *left, void *right) {
+  *(unsigned int *)left += *(unsigned int *)right;
+}
+
+// Map a checkpoint and carry on from the state it holds.
+static void LineDemo_loadCheckpoint(LineDemo *lineDemo, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(CheckpointHeader)) {
+    fprintf(stderr, "Truncated checkpoint (%s)\n", LineDemo_input_file_path);
+    exit(1);
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Cannot map checkpoint (%s)\n", LineDemo_input_file_path);
+    exit(1);
+  }
+  const CheckpointHeader *header = map;
+  const CheckpointRecord *records = (const CheckpointRecord *)(header + 1);
+  unsigned int numOfLines = header->numOfLines;
+  if (header->version != CHECKPOINT_VERSION || numOfLines == 0 ||
+      (st.st_size - sizeof(CheckpointHeader)) / sizeof(CheckpointRecord) <
+          numOfLines) {
+    fprintf(stderr, "Bad checkpoint header (%s)\n",
+            LineDemo_input_file_path);
+    exit(1);
+  }
+
+  Line *lines = new_world(lineDemo, numOfLines);
+  uint64_t *placement = malloc(numOfLines * sizeof(uint64_t));
+  assert(placement);
+  unsigned int cilk_reducer(zero_count, add_count) unplaced = 0;
+  cilk_for (unsigned int i = 0; i < numOfLines; i++) {
+    const CheckpointRecord *r = &records[i];
+    placement[i] = r->quadtreeNode;
+    if (r->quadtreeNode == 0) {
+      unplaced++;
+    }
+    Line *line = &lines[i];
+    line->p1 = (Vec){r->p1x, r->p1y};
+    line->p2 = (Vec){r->p2x, r->p2y};
+    line->p3 = (Vec){r->p3x, r->p3y};
+    line->p4 = (Vec){r->p4x, r->p4y};
+    line->velocity = (Vec){r->vx, r->vy};
+    line->length = r->length;
+    line->color = (Color)r->color;
+    line->id = i;
+    line->quad_tree_node = NULL;
+  }
+  // The tree is only rebuilt in its old shape if every line had a node.
+  if (unplaced == 0) {
+    lineDemo->collisionWorld->quadtreePlacement = placement;
+  } else {
+    free(placement);
+  }
+  lineDemo->count = header->frame;
+  CollisionWorld_setCollisionCounts(lineDemo->collisionWorld,
+                                    header->numLineWallCollisions,
+                                    header->numLineLineCollisions);
+  munmap(map, st.st_size);
+
+  // transfer ownership of lines to collisionWorld
+  CollisionWorld_addLines(lineDemo->collisionWorld, lines, numOfLines);
+}
+
+// Write the state of the simulation to the checkpoint file.  The snapshot is
+// written to a temporary file that then replaces the checkpoint, so a run
+// killed while writing leaves the previous checkpoint intact.
+static void LineDemo_saveCheckpoint(LineDemo *lineDemo) {
+  CollisionWorld *collisionWorld = lineDemo->collisionWorld;
+  unsigned int numOfLines = collisionWorld->numOfLines;
+  size_t size =
+      sizeof(CheckpointHeader) + numOfLines * sizeof(CheckpointRecord);
+  CheckpointHeader *header = malloc(size);
+  if (header == NULL) {
+    fprintf(stderr, "Cannot allocate a checkpoint of %u lines\n", numOfLines);
+    exit(1);
+  }
+  memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+  header->version = CHECKPOINT_VERSION;
+  header->numOfLines = numOfLines;
+  header->frame = lineDemo->count;
+  header->numLineWallCollisions =
+      CollisionWorld_getNumLineWallCollisions(collisionWorld);
+  header->numLineLineCollisions =
+      CollisionWorld_getNumLineLineCollisions(collisionWorld);
+
+  CheckpointRecord *records = (CheckpointRecord *)(header + 1);
+  cilk_for (unsigned int i = 0; i < numOfLines; i++) {
+    const Line *line = collisionWorld->lines[i];
+    records[i] = (CheckpointRecord){
+        .p1x = line->p1.x, .p1y = line->p1.y,
+        .p2x = line->p2.x, .p2y = line->p2.y,
+        .p3x = line->p3.x, .p3y = line->p3.y,
+        .p4x = line->p4.x, .p4y = line->p4.y,
+        .vx = line->velocity.x, .vy = line->velocity.y,
+        .length = line->length,
+        .quadtreeNode = quadtree_placement(line),
+        .color = line->color};
+  }
+
+  size_t pathLength = strlen(LineDemo_checkpoint_path);
+  char *tmpPath = malloc(pathLength + sizeof(".tmp"));
+  assert(tmpPath);
+  memcpy(tmpPath, LineDemo_checkpoint_path, pathLength);
+  memcpy(tmpPath + pathLength, ".tmp", sizeof(".tmp"));
+  FILE *out = fopen(tmpPath, "wb");
+  if (out == NULL || fwrite(header, 1, size, out) != size ||
+      fclose(out) != 0 || rename(tmpPath, LineDemo_checkpoint_path) != 0) {
+    fprintf(stderr, "Cannot write checkpoint (%s)\n",
+            LineDemo_checkpoint_path);
+    exit(1);
+  }
+  free(tmpPath);
+  free(header);
+}
+
+// Read in lines from the input file and add them into collision world for
+// simulation.  The file is a text scene, a binary scene as described in
+// scene.h, or a checkpoint as described in checkpoint.h.
 void LineDemo_createLines(LineDemo *lineDemo) {
   unsigned int lineId = 0;
   unsigned int numOfLines;
@@ -74,34 +342,32 @@ void LineDemo_createLines(LineDemo *lineDemo) {
     exit(1);
   }
 
+  char magic[sizeof(SCENE_MAGIC) - 1];
+  _Static_assert(sizeof(SCENE_MAGIC) == sizeof(CHECKPOINT_MAGIC),
+                 "scene and checkpoint magics must have the same length");
+  if (fread(magic, 1, sizeof(magic), fin) == sizeof(magic)) {
+    if (memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0) {
+      LineDemo_loadBinaryLines(lineDemo, fileno(fin));
+      fclose(fin);
+      return;
+    }
+    if (memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0) {
+      LineDemo_loadCheckpoint(lineDemo, fileno(fin));
+      fclose(fin);
+      return;
+    }
+  }
+  rewind(fin);
+
   fscanf(fin, "%d\n", &numOfLines);
-  lineDemo->collisionWorld = CollisionWorld_new(numOfLines);
+  Line *lines = new_world(lineDemo, numOfLines);
+  double timeStep = lineDemo->collisionWorld->timeStep;
 
-  while (EOF != fscanf(fin, "(%lf, %lf), (%lf, %lf), %lf, %lf, %d\n", &px1,
+  while (lineId < numOfLines &&
+         EOF != fscanf(fin, "(%lf, %lf), (%lf, %lf), %lf, %lf, %d\n", &px1,
                        &py1, &px2, &py2, &vx, &vy, &isGray)) {
-    Line *line = malloc(sizeof(Line));
-
-    // convert window coordinates to box coordinates
-    windowToBox(&line->p1.x, &line->p1.y, px1, py1);
-    windowToBox(&line->p2.x, &line->p2.y, px2, py2);
-
-    line->length = Vec_length(Vec_subtract(line->p1, line->p2));
-
-    // convert window velocity to box velocity
-    velocityWindowToBox(&line->velocity.x, &line->velocity.y, vx, vy);
-
-    line->p3 =
-        Vec_add(line->p1, Vec_multiply(line->velocity,
-                                       lineDemo->collisionWorld->timeStep));
-    line->p4 =
-        Vec_add(line->p2, Vec_multiply(line->velocity,
-                                       lineDemo->collisionWorld->timeStep));
-
-    // store color
-    line->color = (Color)isGray;
-
-    // store line ID
-    line->id = lineId;
+    Line *line = &lines[lineId];
+    init_line(line, lineId, timeStep, px1, py1, px2, py2, vx, vy, isGray);
     lineId++;
 
     // transfer ownership of line to collisionWorld
@@ -114,7 +380,21 @@ void LineDemo_setNumFrames(LineDemo *lineDemo, const unsigned int numFrames) {
   lineDemo->numFrames = numFrames;
 }
 
-void LineDemo_initLine(LineDemo *lineDemo) { LineDemo_createLines(lineDemo); }
+void LineDemo_initLine(LineDemo *lineDemo) {
+  LineDemo_createLines(lineDemo);
+  if (LineDemo_record_path != NULL) {
+    lineDemo->recorder =
+        Recorder_new(LineDemo_record_path, lineDemo->collisionWorld,
+                     LineDemo_record_delta, LineDemo_record_slots);
+    if (lineDemo->recorder == NULL) {
+      fprintf(stderr, "Cannot record to %s\n", LineDemo_record_path);
+      exit(1);
+    }
+    // The first frame recorded is the initial state, which is frame 0 unless
+    // the run carries on from a checkpoint.
+    Recorder_recordFrame(lineDemo->recorder, lineDemo->count);
+  }
+}
 
 Line *LineDemo_getLine(LineDemo *lineDemo, const unsigned int index) {
   return CollisionWorld_getLine(lineDemo->collisionWorld, index);
@@ -132,12 +412,26 @@ unsigned int LineDemo_getNumLineLineCollisions(LineDemo *lineDemo) {
   return CollisionWorld_getNumLineLineCollisions(lineDemo->collisionWorld);
 }
 
+PhaseTimes LineDemo_getPhaseTimes(LineDemo *lineDemo) {
+  return lineDemo->collisionWorld->phaseTimes;
+}
+
+uint64_t LineDemo_getVelocityHash(LineDemo *lineDemo) {
+  return CollisionWorld_velocityHash(lineDemo->collisionWorld);
+}
+
 // The main simulation loop
 bool LineDemo_update(LineDemo *lineDemo, QuadTree *q) {
   lineDemo->count++;
   CollisionWorld_updateLines(lineDemo->collisionWorld, q);
-  if (lineDemo->count > lineDemo->numFrames) {
-    return false;
+  if (lineDemo->recorder != NULL) {
+    Recorder_recordFrame(lineDemo->recorder, lineDemo->count);
+  }
+  bool done = lineDemo->count > lineDemo->numFrames;
+  if (LineDemo_checkpoint_path != NULL &&
+      (done || (LineDemo_checkpoint_interval > 0 &&
+                lineDemo->count % LineDemo_checkpoint_interval == 0))) {
+    LineDemo_saveCheckpoint(lineDemo);
   }
-  return true;
+  return !done;
 }
@@ -26,6 +26,7 @@
 
 #include "./collision_world.h"
 #include "./line.h"
+#include "./recorder.h"
 
 struct LineDemo {
   // Iteration counter
@@ -36,6 +37,9 @@ struct LineDemo {
 
   // Objects for line simulation
   CollisionWorld *collisionWorld;
+
+  // Records every frame, or NULL.
+  Recorder *recorder;
 };
 typedef struct LineDemo LineDemo;
 
@@ -63,9 +67,43 @@ unsigned int LineDemo_getNumLineWallCollisions(LineDemo *lineDemo);
 // Get number of line-line collisions.
 unsigned int LineDemo_getNumLineLineCollisions(LineDemo *lineDemo);
 
+// Returns the time spent in each phase of the simulation so far.
+PhaseTimes LineDemo_getPhaseTimes(LineDemo *lineDemo);
+
+// Returns a hash of every line's velocity.
+uint64_t LineDemo_getVelocityHash(LineDemo *lineDemo);
+
 // Line simulation update function.
 bool LineDemo_update(LineDemo *lineDemo, QuadTree *q);
 
 void LineDemo_setInputFile(char *input_file_path);
 
+// Set the broad phase used by the collision world created for the demo.
+void LineDemo_setBroadPhase(BroadPhase broadPhase);
+
+// Set the number of lines per parallel chunk of the position and wall updates.
+void LineDemo_setGrainSize(unsigned int grainSize);
+
+// Set the number of pairs a quadtree subtree must test to be traversed in
+// parallel.
+void LineDemo_setSpawnCutoff(size_t spawnCutoff);
+
+// Write a checkpoint to the given file at the end of the run, and also every
+// interval frames unless interval is 0.  Each checkpoint replaces the last.
+void LineDemo_setCheckpointFile(char *checkpoint_path, unsigned int interval);
+
+// Record every frame to the given file, delta-encoded if delta is true.
+void LineDemo_setRecordFile(char *record_path, bool delta);
+
+// Let the recorder queue that many frames for its writer thread.
+void LineDemo_setRecordSlots(unsigned int slots);
+
+#ifdef COLLISION_STATS
+// Write the pipeline counters of every frame to the given file as CSV.
+void LineDemo_setStatsDumpFile(char *stats_dump_path);
+
+// Print the pipeline counters summed over every frame so far.
+void LineDemo_printStats(LineDemo *lineDemo);
+#endif
+
 #endif // LINEDEMO_H_
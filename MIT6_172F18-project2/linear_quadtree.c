@@ -0,0 +1,213 @@
+/**
+ * linear_quadtree.c -- pointerless quadtree of Morton-ordered lines
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./linear_quadtree.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A sort key packs the node code, the node level and the line ID, so keys are
+// unique and sorting them orders the lines in pre-order.
+#define KEY_ID_BITS 27
+#define KEY_LEVEL_BITS 5
+
+// Below these sizes sorting and merging are done serially.
+#define SORT_CUTOFF 64
+#define MERGE_CUTOFF 2048
+
+// Spread the low 16 bits of v out to the even bits of the result.
+static inline uint32_t spread_bits(uint32_t v) {
+  v &= 0xFFFF;
+  v = (v | (v << 8)) & 0x00FF00FF;
+  v = (v | (v << 4)) & 0x0F0F0F0F;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+static inline uint32_t morton(uint32_t x, uint32_t y) {
+  return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+// Returns the finest-level cell column (or row) containing coordinate v,
+// clamped to the box.  Clamping preserves overlap, so lines that leave the box
+// before bouncing are still paired correctly.
+static inline uint32_t quantize(double v, double lo, double hi) {
+  double c = floor((v - lo) / (hi - lo) * (1 << MORTON_LEVELS));
+  if (c < 0) {
+    return 0;
+  }
+  if (c >= (1 << MORTON_LEVELS)) {
+    return (1 << MORTON_LEVELS) - 1;
+  }
+  return (uint32_t)c;
+}
+
+// Returns the sort key of line l: the code and level of the deepest node that
+// contains both corners of its swept bounding box.
+static inline uint64_t line_key(Line *l, double t) {
+  double xlo, ylo, xhi, yhi;
+  Line_sweptBounds(l, t, &xlo, &ylo, &xhi, &yhi);
+  uint32_t lo = morton(quantize(xlo, BOX_XMIN, BOX_XMAX),
+                       quantize(ylo, BOX_YMIN, BOX_YMAX));
+  uint32_t hi = morton(quantize(xhi, BOX_XMIN, BOX_XMAX),
+                       quantize(yhi, BOX_YMIN, BOX_YMAX));
+
+  // The corners share the node whose code is their common 2-bit prefix.
+  unsigned int level = MORTON_LEVELS;
+  if (lo != hi) {
+    unsigned int highBit = 31 - __builtin_clz(lo ^ hi);
+    level = MORTON_LEVELS - (highBit / 2 + 1);
+  }
+  unsigned int shift = 2 * (MORTON_LEVELS - level);
+  uint32_t code = shift == 32 ? 0 : (lo >> shift) << shift;
+  return ((uint64_t)code << (KEY_LEVEL_BITS + KEY_ID_BITS)) |
+         ((uint64_t)level << KEY_ID_BITS) | l->id;
+}
+
+static inline uint32_t key_code(uint64_t key) {
+  return key >> (KEY_LEVEL_BITS + KEY_ID_BITS);
+}
+
+static inline unsigned int key_level(uint64_t key) {
+  return (key >> KEY_ID_BITS) & ((1 << KEY_LEVEL_BITS) - 1);
+}
+
+static inline unsigned int key_id(uint64_t key) {
+  return key & ((1 << KEY_ID_BITS) - 1);
+}
+
+// Returns the number of keys in a[0..n) less than k.
+static size_t lower_bound(const uint64_t *a, size_t n, uint64_t k) {
+  size_t lo = 0;
+  size_t hi = n;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (a[mid] < k) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Merge sorted a[0..na) and b[0..nb) into out.  Large merges split around the
+// median of the longer input and merge the two halves in parallel.
+static void merge(const uint64_t *a, size_t na, const uint64_t *b, size_t nb,
+                  uint64_t *out) {
+  if (na < nb) {
+    const uint64_t *t = a;
+    a = b;
+    b = t;
+    size_t tn = na;
+    na = nb;
+    nb = tn;
+  }
+  if (na + nb <= MERGE_CUTOFF) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+      out[k++] = a[i] < b[j] ? a[i++] : b[j++];
+    }
+    memcpy(&out[k], &a[i], sizeof(uint64_t) * (na - i));
+    memcpy(&out[k + na - i], &b[j], sizeof(uint64_t) * (nb - j));
+    return;
+  }
+  size_t ma = na / 2;
+  size_t mb = lower_bound(b, nb, a[ma]);
+  out[ma + mb] = a[ma];
+  cilk_scope {
+    cilk_spawn merge(a, ma, b, mb, out);
+    merge(&a[ma + 1], na - ma - 1, &b[mb], nb - mb, &out[ma + mb + 1]);
+  }
+}
+
+// Sort a[0..n) in place using tmp[0..n) as scratch.
+static void sort_keys(uint64_t *a, uint64_t *tmp, size_t n) {
+  if (n <= SORT_CUTOFF) {
+    for (size_t i = 1; i < n; i++) {
+      uint64_t k = a[i];
+      size_t j = i;
+      for (; j > 0 && a[j - 1] > k; j--) {
+        a[j] = a[j - 1];
+      }
+      a[j] = k;
+    }
+    return;
+  }
+  size_t h = n / 2;
+  cilk_scope {
+    cilk_spawn sort_keys(a, tmp, h);
+    sort_keys(&a[h], &tmp[h], n - h);
+  }
+  merge(a, h, &a[h], n - h, tmp);
+  cilk_for (size_t i = 0; i < n; i++) {
+    a[i] = tmp[i];
+  }
+}
+
+LinearQuadTree *LinearQuadTree_new(CollisionWorld *collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  assert(n <= (1u << KEY_ID_BITS));
+  LinearQuadTree *tree = malloc(sizeof(LinearQuadTree));
+  assert(tree);
+  tree->numOfEntries = n;
+  tree->entries = malloc(sizeof(MortonEntry) * (n > 0 ? n : 1));
+  tree->keys = malloc(sizeof(uint64_t) * (n > 0 ? n : 1));
+  tree->scratch = malloc(sizeof(uint64_t) * (n > 0 ? n : 1));
+  assert(tree->entries && tree->keys && tree->scratch);
+  return tree;
+}
+
+void LinearQuadTree_delete(LinearQuadTree *tree) {
+  if (tree == NULL) {
+    return;
+  }
+  free(tree->entries);
+  free(tree->keys);
+  free(tree->scratch);
+  free(tree);
+}
+
+void LinearQuadTree_build(LinearQuadTree *tree,
+                          CollisionWorld *collisionWorld) {
+  unsigned int n = tree->numOfEntries;
+  double t = collisionWorld->timeStep;
+
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    tree->keys[i] = line_key(collisionWorld->lines[i], t);
+  }
+  sort_keys(tree->keys, tree->scratch, n);
+
+  // Lay the lines out in tree order.
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    uint64_t key = tree->keys[i];
+    MortonEntry *e = &tree->entries[i];
+    e->line = collisionWorld->lines[key_id(key)];
+    e->code = key_code(key);
+    e->end = e->code + ((uint64_t)1 << (2 * (MORTON_LEVELS - key_level(key))));
+    Line_sweptBounds(e->line, t, &e->xlo, &e->ylo, &e->xhi, &e->yhi);
+  }
+}
@@ -0,0 +1,70 @@
+/**
+ * linear_quadtree.h -- pointerless quadtree of Morton-ordered lines
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef LINEAR_QUADTREE_H_
+#define LINEAR_QUADTREE_H_
+
+#include <stdint.h>
+
+#include "./collision_world.h"
+#include "./line.h"
+
+// Depth of the finest quadtree level.  Cells at this level are 2^-16 of the
+// box wide, and a node's Morton code takes 2 * MORTON_LEVELS bits.
+#define MORTON_LEVELS 16
+
+// A line in the linear quadtree, stored in the node that most tightly contains
+// its swept bounding box.
+typedef struct {
+  // Morton code of the node's lower-left corner at the finest level.  The
+  // node's subtree covers the codes from code up to, but not including, end.
+  uint32_t code;
+  uint64_t end;
+  double xlo;
+  double xhi;
+  double ylo;
+  double yhi;
+  Line *line;
+} MortonEntry;
+
+// A quadtree kept as an array of lines sorted by (node code, node level).
+// That is a pre-order of the tree: every node's lines are contiguous and
+// followed by the lines of its subtree, so no nodes are ever materialized.
+struct LinearQuadTree {
+  MortonEntry *entries;
+  unsigned int numOfEntries;
+  // Sort keys and scratch space for sorting them.
+  uint64_t *keys;
+  uint64_t *scratch;
+};
+typedef struct LinearQuadTree LinearQuadTree;
+
+LinearQuadTree *LinearQuadTree_new(CollisionWorld *collisionWorld);
+
+void LinearQuadTree_delete(LinearQuadTree *tree);
+
+// Rebuild the tree for the coming time step.
+void LinearQuadTree_build(LinearQuadTree *tree,
+                          CollisionWorld *collisionWorld);
+
+#endif  // LINEAR_QUADTREE_H_
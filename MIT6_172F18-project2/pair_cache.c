@@ -0,0 +1,237 @@
+/**
+ * pair_cache.c -- candidate pairs reused across frames
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./pair_cache.h"
+
+#include <assert.h>
+#include <cilk/cilk.h>
+#include <stdlib.h>
+
+#include "./vec.h"
+
+// Frames the margins are first sized for, and the factor the tuner first
+// moves that by.
+#define INITIAL_FRAMES 4.0
+#define INITIAL_STEP 1.5
+
+static void zero_count(void *view) { *(unsigned int *)view = 0; }
+
+static void add_count(void *left, void *right) {
+  *(unsigned int *)left += *(unsigned int *)right;
+}
+
+static inline void set_box(PairBox *box, Line *line, double t) {
+  Line_sweptBounds(line, t, &box->xlo, &box->ylo, &box->xhi, &box->yhi);
+}
+
+static inline bool contains(const PairBox *outer, const PairBox *inner) {
+  return outer->xlo <= inner->xlo && inner->xhi <= outer->xhi &&
+         outer->ylo <= inner->ylo && inner->yhi <= outer->yhi;
+}
+
+static int compare_entries(const void *a, const void *b) {
+  double x = ((const PairCacheEntry *)a)->box.xlo;
+  double y = ((const PairCacheEntry *)b)->box.xlo;
+  return (x > y) - (x < y);
+}
+
+static double total_time(const PhaseTimes *times) {
+  return times->broadPhase + times->narrowPhase + times->sort + times->solve +
+         times->update;
+}
+
+// Count the partners of entries[i], or list them at out if it is not NULL:
+// the entries after it in x order whose grown boxes overlap its own.
+static size_t sweep_entry(PairCache *cache, unsigned int i, Line **out) {
+  const PairCacheEntry *entries = cache->entries;
+  const PairBox *box = &entries[i].box;
+  size_t k = 0;
+  for (unsigned int j = i + 1;
+       j < cache->numOfLines && entries[j].box.xlo <= box->xhi; ++j) {
+    if (entries[j].box.ylo > box->yhi || entries[j].box.yhi < box->ylo) {
+      continue;
+    }
+    if (out != NULL) {
+      out[k] = entries[j].line;
+    }
+    k++;
+  }
+  return k;
+}
+
+// Move the number of frames the margins are sized for, based on how the
+// cycle that just ended compares with the one before it.
+static void tune(PairCache *cache, CollisionWorld *collisionWorld) {
+  double now = total_time(&collisionWorld->phaseTimes);
+  if (cache->cycleFrames > 0) {
+    double cost = (now - cache->cycleStart) / cache->cycleFrames;
+    if (cache->lastCost > 0 && cost > cache->lastCost) {
+      cache->step = 1 / cache->step;
+    }
+    cache->lastCost = cost;
+    cache->frames *= cache->step;
+    if (cache->frames < PAIR_CACHE_MIN_FRAMES) {
+      cache->frames = PAIR_CACHE_MIN_FRAMES;
+    } else if (cache->frames > PAIR_CACHE_MAX_FRAMES) {
+      cache->frames = PAIR_CACHE_MAX_FRAMES;
+    }
+  }
+  cache->cycleStart = now;
+  cache->cycleFrames = 0;
+}
+
+// Grow every line's current swept box by its margin and list the pairs whose
+// grown boxes overlap.
+static void rebuild(PairCache *cache, CollisionWorld *collisionWorld) {
+  unsigned int n = cache->numOfLines;
+  PairCacheEntry *entries = cache->entries;
+  double t = collisionWorld->timeStep;
+
+  // A line that is slower than average may be sped up by a collision, so no
+  // margin is sized for less than the average speed.
+  double meanSpeed = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    meanSpeed += Vec_length(entries[i].line->velocity);
+  }
+  meanSpeed /= n;
+
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    Line *line = entries[i].line;
+    double speed = Vec_length(line->velocity);
+    double margin =
+        cache->frames * t * (speed > meanSpeed ? speed : meanSpeed);
+    PairBox box = cache->current[line->id];
+    box.xlo -= margin;
+    box.xhi += margin;
+    box.ylo -= margin;
+    box.yhi += margin;
+    entries[i].box = box;
+    cache->grown[line->id] = box;
+  }
+
+  // Insertion sort on xlo.  The previous order is nearly right.
+  for (unsigned int i = 1; i < n; i++) {
+    if (entries[i - 1].box.xlo <= entries[i].box.xlo) {
+      continue;
+    }
+    PairCacheEntry e = entries[i];
+    unsigned int j = i;
+    do {
+      entries[j] = entries[j - 1];
+      j--;
+    } while (j > 0 && entries[j - 1].box.xlo > e.box.xlo);
+    entries[j] = e;
+  }
+
+  // Count each entry's partners, lay the lists out back to back, then fill
+  // them in.
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    cache->start[i + 1] = sweep_entry(cache, i, NULL);
+  }
+  cache->start[0] = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    cache->start[i + 1] += cache->start[i];
+  }
+  if (cache->start[n] > cache->partnerCap) {
+    cache->partnerCap = cache->start[n] * 2;
+    free(cache->partners);
+    cache->partners = malloc(cache->partnerCap * sizeof(Line *));
+    assert(cache->partners);
+  }
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    sweep_entry(cache, i, &cache->partners[cache->start[i]]);
+  }
+  cache->rebuilds++;
+}
+
+PairCache *PairCache_new(CollisionWorld *collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  PairCache *cache = malloc(sizeof(PairCache));
+  assert(cache);
+  cache->numOfLines = n;
+  cache->entries = malloc(sizeof(PairCacheEntry) * (n > 0 ? n : 1));
+  cache->grown = malloc(sizeof(PairBox) * (n > 0 ? n : 1));
+  cache->current = malloc(sizeof(PairBox) * (n > 0 ? n : 1));
+  cache->start = malloc(sizeof(size_t) * (n + 1));
+  assert(cache->entries && cache->grown && cache->current && cache->start);
+  cache->partners = NULL;
+  cache->partnerCap = 0;
+  cache->frames = INITIAL_FRAMES;
+  cache->step = INITIAL_STEP;
+  cache->lastCost = 0;
+  cache->cycleFrames = 0;
+  cache->rebuilds = 0;
+  cache->framesReused = 0;
+  cache->start[0] = 0;
+  if (n == 0) {
+    return cache;
+  }
+
+  double t = collisionWorld->timeStep;
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    Line *line = collisionWorld->lines[i];
+    cache->entries[i].line = line;
+    set_box(&cache->current[line->id], line, t);
+    cache->entries[i].box = cache->current[line->id];
+  }
+  // The initial order has no coherence to exploit, so sort it outright.
+  qsort(cache->entries, n, sizeof(PairCacheEntry), compare_entries);
+  tune(cache, collisionWorld);
+  rebuild(cache, collisionWorld);
+  return cache;
+}
+
+void PairCache_delete(PairCache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+  free(cache->entries);
+  free(cache->grown);
+  free(cache->current);
+  free(cache->start);
+  free(cache->partners);
+  free(cache);
+}
+
+void PairCache_update(PairCache *cache, CollisionWorld *collisionWorld) {
+  unsigned int n = cache->numOfLines;
+  double t = collisionWorld->timeStep;
+  cache->cycleFrames++;
+
+  unsigned int cilk_reducer(zero_count, add_count) escaped = 0;
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    Line *line = collisionWorld->lines[i];
+    PairBox *box = &cache->current[line->id];
+    set_box(box, line, t);
+    if (!contains(&cache->grown[line->id], box)) {
+      escaped++;
+    }
+  }
+
+  if (escaped > 0) {
+    tune(cache, collisionWorld);
+    rebuild(cache, collisionWorld);
+  } else {
+    cache->framesReused++;
+  }
+}
@@ -0,0 +1,97 @@
+/**
+ * pair_cache.h -- candidate pairs reused across frames
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef PAIR_CACHE_H_
+#define PAIR_CACHE_H_
+
+#include "./collision_world.h"
+#include "./line.h"
+
+// Range of the number of frames the margins are sized for.
+#define PAIR_CACHE_MIN_FRAMES 1.0
+#define PAIR_CACHE_MAX_FRAMES 64.0
+
+typedef struct {
+  double xlo;
+  double xhi;
+  double ylo;
+  double yhi;
+} PairBox;
+
+// A line's swept bounding box grown by its margin.
+typedef struct {
+  PairBox box;
+  Line *line;
+} PairCacheEntry;
+
+// A Verlet list of candidate pairs.  When the cache is built, every line's
+// swept bounding box is grown by a margin sized for a few frames of its
+// motion, and every pair whose grown boxes overlap is listed.  As long as each
+// line's swept box stays inside its grown box, every pair whose swept boxes
+// overlap is still listed, so the list is reused and only the narrow phase
+// runs.  The cache is rebuilt as soon as one line leaves its grown box.
+struct PairCache {
+  unsigned int numOfLines;
+  // Grown boxes, sorted by their lower x bound.  The order is kept between
+  // rebuilds, since lines only move a little.
+  PairCacheEntry *entries;
+  // Each line's grown box and its swept box for the coming time step,
+  // indexed by line ID.
+  PairBox *grown;
+  PairBox *current;
+  // The partners of entries[i] are partners[start[i]] up to, but not
+  // including, partners[start[i + 1]].
+  size_t *start;
+  Line **partners;
+  size_t partnerCap;
+
+  // Number of frames of motion the margins are sized for.  It is tuned by
+  // comparing the time per frame of consecutive rebuild cycles, as measured
+  // by the world's phase times, and moved by the factor step, which flips
+  // whenever a cycle was slower than the last.
+  double frames;
+  double step;
+  double lastCost;
+  double cycleStart;
+  unsigned int cycleFrames;
+
+  size_t rebuilds;
+  size_t framesReused;
+};
+typedef struct PairCache PairCache;
+
+// Build the cache for the lines currently in the world.
+PairCache *PairCache_new(CollisionWorld *collisionWorld);
+
+void PairCache_delete(PairCache *cache);
+
+// Refresh every line's swept box for the coming time step, and rebuild the
+// cache if any line has left its grown box.
+void PairCache_update(PairCache *cache, CollisionWorld *collisionWorld);
+
+static inline bool PairBox_overlap(const PairBox *a, const PairBox *b) {
+  return a->xlo <= b->xhi && b->xlo <= a->xhi && a->ylo <= b->yhi &&
+         b->ylo <= a->yhi;
+}
+
+#endif  // PAIR_CACHE_H_
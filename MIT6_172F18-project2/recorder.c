@@ -0,0 +1,269 @@
+/**
+ * recorder.c -- record every frame of a simulation on a background thread
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./recorder.h"
+
+#include <assert.h>
+#include <cilk/cilk.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Encode d as a zigzag LEB128 varint at out.  Returns the number of bytes.
+static inline size_t put_delta(uint8_t *out, int16_t d) {
+  uint32_t z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 15);
+  size_t n = 0;
+  while (z >= 0x80) {
+    out[n++] = (uint8_t)(z | 0x80);
+    z >>= 7;
+  }
+  out[n++] = (uint8_t)z;
+  return n;
+}
+
+// Encode and write one queued frame.  Runs on the writer thread.  Returns
+// false if a write failed.
+static bool write_slot(Recorder *recorder, const RecorderSlot *slot) {
+  size_t values = 4 * (size_t)recorder->numOfLines;
+  bool keyframe = !recorder->delta ||
+                  recorder->framesWritten % RECORDING_KEYFRAME_INTERVAL == 0;
+  const void *positions = slot->positions;
+  size_t positionBytes = values * sizeof(uint16_t);
+  if (!keyframe) {
+    positionBytes = 0;
+    for (size_t i = 0; i < values; i++) {
+      int16_t d = (int16_t)(slot->positions[i] - recorder->previous[i]);
+      positionBytes += put_delta(&recorder->encoded[positionBytes], d);
+    }
+    positions = recorder->encoded;
+  }
+
+  RecordedFrame header = {.frame = slot->frame,
+                          .numOfEvents = slot->numOfEvents,
+                          .positionBytes = positionBytes,
+                          .keyframe = keyframe};
+  if (fwrite(&header, sizeof(header), 1, recorder->out) != 1 ||
+      fwrite(slot->events, sizeof(RecordedEvent), slot->numOfEvents,
+             recorder->out) != slot->numOfEvents ||
+      fwrite(positions, 1, positionBytes, recorder->out) != positionBytes) {
+    return false;
+  }
+
+  if (recorder->delta) {
+    memcpy(recorder->previous, slot->positions, values * sizeof(uint16_t));
+  }
+  recorder->framesWritten++;
+  return true;
+}
+
+// Wake the writer thread, if it is waiting, after queuing a frame or setting
+// done.  The fence orders that store before the load of sleeping, and pairs
+// with the one in writer_main: either the writer sees the new head or done
+// before it waits, or this sees sleeping set and signals.
+static void wake_writer(Recorder *recorder) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!atomic_load_explicit(&recorder->sleeping, memory_order_relaxed)) {
+    return;
+  }
+  pthread_mutex_lock(&recorder->lock);
+  pthread_cond_signal(&recorder->queued);
+  pthread_mutex_unlock(&recorder->lock);
+}
+
+static void *writer_main(void *arg) {
+  Recorder *recorder = arg;
+  size_t tail = atomic_load_explicit(&recorder->tail, memory_order_relaxed);
+  while (true) {
+    // done is read before head, so once it is set head is final.
+    bool done = atomic_load_explicit(&recorder->done, memory_order_acquire);
+    size_t head = atomic_load_explicit(&recorder->head, memory_order_acquire);
+    if (tail == head) {
+      if (done) {
+        break;
+      }
+      // Both are checked again once sleeping is set, under the lock that
+      // wake_writer takes to signal, so no wakeup is missed.
+      pthread_mutex_lock(&recorder->lock);
+      atomic_store_explicit(&recorder->sleeping, true, memory_order_relaxed);
+      atomic_thread_fence(memory_order_seq_cst);
+      while (!atomic_load_explicit(&recorder->done, memory_order_acquire) &&
+             atomic_load_explicit(&recorder->head, memory_order_acquire) ==
+                 tail) {
+        pthread_cond_wait(&recorder->queued, &recorder->lock);
+      }
+      atomic_store_explicit(&recorder->sleeping, false, memory_order_relaxed);
+      pthread_mutex_unlock(&recorder->lock);
+      continue;
+    }
+    // After a failure the slots are still released, so that the simulation
+    // is never held up by a recording that cannot be completed.
+    if (!atomic_load_explicit(&recorder->failed, memory_order_relaxed) &&
+        !write_slot(recorder, &recorder->slots[tail % recorder->numOfSlots])) {
+      atomic_store_explicit(&recorder->failed, true, memory_order_relaxed);
+    }
+    tail++;
+    atomic_store_explicit(&recorder->tail, tail, memory_order_release);
+  }
+  return NULL;
+}
+
+Recorder *Recorder_new(const char *path, CollisionWorld *collisionWorld,
+                       bool delta, unsigned int numOfSlots) {
+  FILE *out = fopen(path, "wb");
+  if (out == NULL) {
+    return NULL;
+  }
+  Recorder *recorder = malloc(sizeof(Recorder));
+  assert(recorder);
+  recorder->out = out;
+  recorder->collisionWorld = collisionWorld;
+  recorder->numOfLines = collisionWorld->numOfLines;
+  recorder->delta = delta;
+  recorder->eventLog = IntersectionEventList_make();
+
+  size_t values = 4 * (size_t)recorder->numOfLines;
+  recorder->numOfSlots = numOfSlots;
+  recorder->slots = malloc(numOfSlots * sizeof(RecorderSlot));
+  assert(recorder->slots);
+  for (unsigned int s = 0; s < numOfSlots; s++) {
+    RecorderSlot *slot = &recorder->slots[s];
+    slot->positions = malloc(values * sizeof(uint16_t));
+    assert(slot->positions);
+    slot->events = NULL;
+    slot->numOfEvents = 0;
+    slot->eventCap = 0;
+  }
+  atomic_init(&recorder->head, 0);
+  atomic_init(&recorder->tail, 0);
+  atomic_init(&recorder->done, false);
+  recorder->previous = NULL;
+  recorder->encoded = NULL;
+  if (delta) {
+    recorder->previous = malloc(values * sizeof(uint16_t));
+    // A zigzag encoded 16-bit difference takes at most three bytes.
+    recorder->encoded = malloc(values * 3);
+    assert(recorder->previous && recorder->encoded);
+  }
+  recorder->framesWritten = 0;
+  recorder->dropped = 0;
+  atomic_init(&recorder->failed, false);
+  recorder->finished = false;
+
+  RecordingHeader header = {.version = RECORDING_VERSION,
+                            .numOfLines = recorder->numOfLines,
+                            .flags = delta ? RECORDING_DELTA : 0};
+  memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+  if (fwrite(&header, sizeof(header), 1, out) != 1) {
+    atomic_store_explicit(&recorder->failed, true, memory_order_relaxed);
+  }
+
+  collisionWorld->eventLog = &recorder->eventLog;
+  pthread_mutex_init(&recorder->lock, NULL);
+  pthread_cond_init(&recorder->queued, NULL);
+  atomic_init(&recorder->sleeping, false);
+  if (pthread_create(&recorder->writer, NULL, writer_main, recorder) != 0) {
+    fprintf(stderr, "Cannot start the recorder thread\n");
+    exit(1);
+  }
+  return recorder;
+}
+
+void Recorder_recordFrame(Recorder *recorder, unsigned int frame) {
+  size_t head = atomic_load_explicit(&recorder->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&recorder->tail, memory_order_acquire) ==
+      recorder->numOfSlots) {
+    // The event log is left as it is, so that the frame's events go with
+    // the next one queued.
+    recorder->dropped++;
+    return;
+  }
+
+  RecorderSlot *slot = &recorder->slots[head % recorder->numOfSlots];
+  slot->frame = frame;
+  uint16_t *p = slot->positions;
+  Line **lines = recorder->collisionWorld->lines;
+  cilk_for (unsigned int i = 0; i < recorder->numOfLines; i++) {
+    Line *l = lines[i];
+    p[4 * i + 0] = Recording_quantize(l->p1.x, BOX_XMIN, BOX_XMAX);
+    p[4 * i + 1] = Recording_quantize(l->p1.y, BOX_YMIN, BOX_YMAX);
+    p[4 * i + 2] = Recording_quantize(l->p2.x, BOX_XMIN, BOX_XMAX);
+    p[4 * i + 3] = Recording_quantize(l->p2.y, BOX_YMIN, BOX_YMAX);
+  }
+
+  IntersectionEventList *log = &recorder->eventLog;
+  if (log->len > slot->eventCap) {
+    slot->eventCap = log->len;
+    slot->events =
+        realloc(slot->events, slot->eventCap * sizeof(RecordedEvent));
+    assert(slot->events);
+  }
+  for (size_t i = 0; i < log->len; i++) {
+    slot->events[i] =
+        (RecordedEvent){.l1 = log->events[i].l1->id,
+                        .l2 = log->events[i].l2->id,
+                        .intersectionType = log->events[i].intersectionType};
+  }
+  slot->numOfEvents = log->len;
+  IntersectionEventList_clear(log);
+
+  atomic_store_explicit(&recorder->head, head + 1, memory_order_release);
+  wake_writer(recorder);
+}
+
+bool Recorder_finish(Recorder *recorder) {
+  if (!recorder->finished) {
+    atomic_store_explicit(&recorder->done, true, memory_order_release);
+    wake_writer(recorder);
+    pthread_join(recorder->writer, NULL);
+    // Buffered frames are only written, and may only fail, here.
+    if (fclose(recorder->out) != 0) {
+      atomic_store_explicit(&recorder->failed, true, memory_order_relaxed);
+    }
+    recorder->finished = true;
+  }
+  return !atomic_load_explicit(&recorder->failed, memory_order_relaxed);
+}
+
+void Recorder_delete(Recorder *recorder) {
+  if (!Recorder_finish(recorder)) {
+    fprintf(stderr, "Error writing the recording, which is incomplete\n");
+  }
+  if (recorder->dropped > 0) {
+    fprintf(stderr,
+            "The recording is missing %zu frames the writer could not keep "
+            "up with; queue more with -q\n",
+            recorder->dropped);
+  }
+
+  recorder->collisionWorld->eventLog = NULL;
+  IntersectionEventList_free(&recorder->eventLog);
+  pthread_mutex_destroy(&recorder->lock);
+  pthread_cond_destroy(&recorder->queued);
+  for (unsigned int s = 0; s < recorder->numOfSlots; s++) {
+    free(recorder->slots[s].positions);
+    free(recorder->slots[s].events);
+  }
+  free(recorder->slots);
+  free(recorder->previous);
+  free(recorder->encoded);
+  free(recorder);
+}
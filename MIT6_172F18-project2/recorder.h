@@ -0,0 +1,121 @@
+/**
+ * recorder.h -- record every frame of a simulation on a background thread
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "./collision_world.h"
+#include "./recording.h"
+
+// Frames that can be queued for the writer thread, unless set otherwise.
+// Each slot holds eight bytes per line.
+#define RECORDER_DEFAULT_SLOTS 64
+
+// One queued frame: quantized endpoints and the frame's collision events.
+typedef struct {
+  uint32_t frame;
+  uint16_t *positions;
+  RecordedEvent *events;
+  size_t numOfEvents;
+  size_t eventCap;
+} RecorderSlot;
+
+// Writes the frames of a simulation to a recording, in the format described
+// in recording.h.  The simulation thread only quantizes each frame into a free
+// slot of a single-producer single-consumer ring; a writer thread encodes the
+// queued frames and does all the I/O, and sleeps while none is queued.
+//
+// The simulation never waits for the disk.  A frame that finds every slot
+// still queued is dropped and counted instead, and its events are recorded
+// with the next frame that is queued.  A recording therefore holds every
+// frame only if the disk keeps up with the simulation, on average over
+// numOfSlots frames.  Recorder_delete warns of dropped frames, and replay
+// reports the gaps they leave.
+struct Recorder {
+  FILE *out;
+  CollisionWorld *collisionWorld;
+  unsigned int numOfLines;
+  bool delta;
+
+  // Events solved since the last recorded frame, filled in by the world.
+  IntersectionEventList eventLog;
+
+  // Frame i is queued in slots[i % numOfSlots].  head is the number of
+  // frames queued, advanced only by the simulation thread, and tail the
+  // number written, advanced only by the writer thread.
+  RecorderSlot *slots;
+  unsigned int numOfSlots;
+  atomic_size_t head;
+  atomic_size_t tail;
+  // Set once the last frame has been queued.
+  atomic_bool done;
+  pthread_t writer;
+  // The writer waits on queued while the ring is empty, with sleeping set.
+  // The simulation thread only takes the lock to signal it when it finds
+  // sleeping set after queuing a frame or setting done.
+  pthread_mutex_t lock;
+  pthread_cond_t queued;
+  atomic_bool sleeping;
+
+  // Writer state: the previous frame's endpoints, for delta encoding, and
+  // the encoded endpoints of the frame being written.
+  uint16_t *previous;
+  uint8_t *encoded;
+  size_t framesWritten;
+
+  // Number of frames dropped because no slot was free.
+  size_t dropped;
+
+  // Set on the first write that fails, after which queued frames are
+  // discarded instead of written.
+  atomic_bool failed;
+  // Set once the writer thread has stopped and the file is closed.
+  bool finished;
+};
+typedef struct Recorder Recorder;
+
+// Start recording the world's frames to the file at path, delta-encoded if
+// delta is true, with room to queue numOfSlots frames for the writer.
+// Returns NULL if the file cannot be created.
+Recorder *Recorder_new(const char *path, CollisionWorld *collisionWorld,
+                       bool delta, unsigned int numOfSlots);
+
+// Queue the world's current state, and the events solved since the previous
+// queued frame, as the given frame.  Never waits: if every slot is still
+// queued, the frame is dropped.
+void Recorder_recordFrame(Recorder *recorder, unsigned int frame);
+
+// Write every queued frame, stop the writer thread and close the file.
+// Returns false if the recording is incomplete because a write failed.
+bool Recorder_finish(Recorder *recorder);
+
+// Finish the recording if that has not been done, report on stderr if it is
+// incomplete or frames were dropped, and free the recorder.
+void Recorder_delete(Recorder *recorder);
+
+#endif  // RECORDER_H_
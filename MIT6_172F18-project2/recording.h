@@ -0,0 +1,84 @@
+/**
+ * recording.h -- recorded simulation file format
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef RECORDING_H_
+#define RECORDING_H_
+
+#include <stdint.h>
+
+#include "./line.h"
+
+// A recording is a header followed by one record per frame, in the byte order
+// of the machine that wrote it.  Each frame record is a RecordedFrame, its
+// collision events, then the endpoints of every line.
+//
+// Endpoints are quantized to 16 bits across the box, four values per line in
+// the order p1.x, p1.y, p2.x, p2.y.  A key frame stores them as uint16_t.  In
+// a delta-encoded recording the other frames store each value's difference
+// from the previous frame, modulo 2^16, zigzag encoded as a LEB128 varint, so
+// a line that moves less than 64 quanta in each coordinate takes four bytes.
+//
+// Frames the writer could not keep up with are missing, and their events are
+// stored with the next frame present.
+
+#define RECORDING_MAGIC "LREC"
+#define RECORDING_VERSION 1
+
+// Flags of a recording.
+#define RECORDING_DELTA 1
+
+// Frames between key frames of a delta-encoded recording.
+#define RECORDING_KEYFRAME_INTERVAL 64
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t numOfLines;
+  uint32_t flags;
+} RecordingHeader;
+
+typedef struct {
+  uint32_t frame;
+  uint32_t numOfEvents;
+  // Bytes of encoded endpoints following the events.
+  uint32_t positionBytes;
+  uint32_t keyframe;
+} RecordedFrame;
+
+typedef struct {
+  uint32_t l1;
+  uint32_t l2;
+  uint32_t intersectionType;
+} RecordedEvent;
+
+// Quantize a box coordinate to 16 bits, and back.
+static inline uint16_t Recording_quantize(double x, double lo, double hi) {
+  double q = (x - lo) / (hi - lo) * UINT16_MAX + 0.5;
+  return q <= 0 ? 0 : q >= UINT16_MAX ? UINT16_MAX : (uint16_t)q;
+}
+
+static inline double Recording_dequantize(uint16_t q, double lo, double hi) {
+  return lo + q * (hi - lo) / UINT16_MAX;
+}
+
+#endif  // RECORDING_H_
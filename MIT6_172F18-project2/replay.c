@@ -0,0 +1,215 @@
+/**
+ * replay.c -- read back a recording made with screensaver -r or -R
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./intersection_detection.h"
+#include "./line.h"
+#include "./recording.h"
+
+// Longest varint of a zigzag encoded 16-bit difference.
+#define MAX_DELTA_BYTES 3
+
+// Decode a zigzag LEB128 varint at *in into *d, advancing *in past it.
+// Returns false if the varint is longer than MAX_DELTA_BYTES or does not end
+// before end.
+static inline bool get_delta(const uint8_t **in, const uint8_t *end,
+                             int16_t *d) {
+  uint32_t z = 0;
+  int shift = 0;
+  uint8_t b;
+  do {
+    if (*in == end || shift == 7 * MAX_DELTA_BYTES) {
+      return false;
+    }
+    b = *(*in)++;
+    z |= (uint32_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  *d = (int16_t)((z >> 1) ^ -(z & 1));
+  return true;
+}
+
+static void read_or_die(void *buf, size_t size, size_t n, FILE *in) {
+  if (fread(buf, size, n, in) != n) {
+    fprintf(stderr, "Truncated recording\n");
+    exit(1);
+  }
+}
+
+// Print the endpoints of every line in window coordinates.
+static void print_frame(const uint16_t *positions, uint32_t numOfLines) {
+  for (uint32_t i = 0; i < numOfLines; i++) {
+    window_dimension x1, y1, x2, y2;
+    const uint16_t *p = &positions[4 * i];
+    boxToWindow(&x1, &y1, Recording_dequantize(p[0], BOX_XMIN, BOX_XMAX),
+                Recording_dequantize(p[1], BOX_YMIN, BOX_YMAX));
+    boxToWindow(&x2, &y2, Recording_dequantize(p[2], BOX_XMIN, BOX_XMAX),
+                Recording_dequantize(p[3], BOX_YMIN, BOX_YMAX));
+    printf("(%f, %f), (%f, %f)\n", x1, y1, x2, y2);
+  }
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [-q] [-e] [-f frame] <recording>\n", name);
+  printf("  -q : only print the totals\n");
+  printf("  -e : print every collision event\n");
+  printf("  -f : print the endpoints of every line at this frame\n");
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  bool quiet = false;
+  bool printEvents = false;
+  long dumpFrame = -1;
+  int optchar;
+  while ((optchar = getopt(argc, argv, "qef:")) != -1) {
+    switch (optchar) {
+    case 'q':
+      quiet = true;
+      break;
+    case 'e':
+      printEvents = true;
+      break;
+    case 'f':
+      dumpFrame = atol(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+  }
+
+  FILE *in = fopen(argv[optind], "rb");
+  if (in == NULL) {
+    fprintf(stderr, "Cannot open %s\n", argv[optind]);
+    exit(1);
+  }
+  RecordingHeader header;
+  read_or_die(&header, sizeof(header), 1, in);
+  if (memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != RECORDING_VERSION) {
+    fprintf(stderr, "%s is not a recording\n", argv[optind]);
+    exit(1);
+  }
+  uint32_t numOfLines = header.numOfLines;
+  size_t values = 4 * (size_t)numOfLines;
+  printf("%u lines, %s\n", numOfLines,
+         header.flags & RECORDING_DELTA ? "delta-encoded" : "raw");
+
+  uint16_t *positions = calloc(values, sizeof(uint16_t));
+  uint8_t *encoded = malloc(values * MAX_DELTA_BYTES);
+  RecordedEvent *events = NULL;
+  size_t eventCap = 0;
+  size_t frames = 0;
+  // Frames absent between those recorded, dropped by the recorder.
+  size_t missing = 0;
+  size_t gaps = 0;
+  uint32_t lastFrame = 0;
+  size_t bytes = sizeof(header);
+  size_t eventsByType[ALREADY_INTERSECTED + 1] = {0};
+  RecordedFrame frame;
+  while (fread(&frame, sizeof(frame), 1, in) == 1) {
+    if (frame.numOfEvents > eventCap) {
+      eventCap = frame.numOfEvents;
+      events = realloc(events, eventCap * sizeof(RecordedEvent));
+    }
+    read_or_die(events, sizeof(RecordedEvent), frame.numOfEvents, in);
+    if (frame.keyframe) {
+      if (frame.positionBytes != values * sizeof(uint16_t)) {
+        fprintf(stderr, "Frame %u has the wrong size\n", frame.frame);
+        exit(1);
+      }
+      read_or_die(positions, sizeof(uint16_t), values, in);
+    } else {
+      if (frame.positionBytes > values * MAX_DELTA_BYTES) {
+        fprintf(stderr, "Frame %u has the wrong size\n", frame.frame);
+        exit(1);
+      }
+      read_or_die(encoded, 1, frame.positionBytes, in);
+      // Every value must decode within the frame, and use all of it.
+      const uint8_t *p = encoded;
+      const uint8_t *end = encoded + frame.positionBytes;
+      for (size_t i = 0; i < values; i++) {
+        int16_t d;
+        if (!get_delta(&p, end, &d)) {
+          fprintf(stderr, "Frame %u is corrupt\n", frame.frame);
+          exit(1);
+        }
+        positions[i] += d;
+      }
+      if (p != end) {
+        fprintf(stderr, "Frame %u is corrupt\n", frame.frame);
+        exit(1);
+      }
+    }
+
+    for (uint32_t e = 0; e < frame.numOfEvents; e++) {
+      if (events[e].intersectionType <= ALREADY_INTERSECTED) {
+        eventsByType[events[e].intersectionType]++;
+      }
+      if (printEvents) {
+        printf("frame %u: %u with %u, type %u\n", frame.frame, events[e].l1,
+               events[e].l2, events[e].intersectionType);
+      }
+    }
+    if (!quiet) {
+      printf("frame %u: %u events, %u bytes%s\n", frame.frame,
+             frame.numOfEvents, frame.positionBytes,
+             frame.keyframe ? ", key frame" : "");
+    }
+    if (frame.frame == dumpFrame) {
+      print_frame(positions, numOfLines);
+    }
+    if (frames > 0 && frame.frame > lastFrame + 1) {
+      missing += frame.frame - lastFrame - 1;
+      gaps++;
+    }
+    lastFrame = frame.frame;
+    frames++;
+    bytes += sizeof(frame) + frame.numOfEvents * sizeof(RecordedEvent) +
+             frame.positionBytes;
+  }
+  fclose(in);
+
+  size_t totalEvents = eventsByType[L1_WITH_L2] + eventsByType[L2_WITH_L1] +
+                       eventsByType[ALREADY_INTERSECTED];
+  printf("%zu frames, %zu bytes (%.2f bytes per line per frame)\n", frames,
+         bytes, frames ? (double)bytes / frames / numOfLines : 0.0);
+  printf("%zu frames missing, in %zu gaps\n", missing, gaps);
+  printf("%zu events: %zu L1_WITH_L2, %zu L2_WITH_L1, "
+         "%zu ALREADY_INTERSECTED\n",
+         totalEvents, eventsByType[L1_WITH_L2], eventsByType[L2_WITH_L1],
+         eventsByType[ALREADY_INTERSECTED]);
+  free(positions);
+  free(encoded);
+  free(events);
+  return 0;
+}
@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2012 the Massachusetts Institute of Technology
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Parallel scaling of the screensaver across worker counts.
+
+Three measurements are made:
+
+  * Work, span and parallelism of every input scene, from one run of the
+    simulator built with Cilkscale.
+  * Strong scaling: every input scene is simulated with CILK_NWORKERS set to
+    each worker count, and the speedup and efficiency over one worker are
+    reported.
+  * Weak scaling: for each worker count, a scene of --weak-lines lines per
+    worker is generated with scene_gen and simulated with that many workers,
+    so that ideally the time stays flat.  The quadtree does more than linear
+    work as a random scene grows, so these runs use the grid by default.
+
+The collision counts of every scene must not depend on the number of workers.
+The script exits with a non-zero status if they do, or if the efficiency at
+the largest worker count falls below --min-efficiency.
+"""
+
+import argparse
+import csv
+import glob
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+
+RESULT_PATTERNS = {
+    'elapsed': re.compile(r'Elapsed execution time: ([0-9.]+)s'),
+    'wall': re.compile(r'(\d+) Line-Wall Collisions'),
+    'line': re.compile(r'(\d+) Line-Line Collisions'),
+}
+
+
+def run(binary, broadphase, scene, frames, workers=None, extra_env=None):
+  """Run the simulator once and return its output."""
+  env = dict(os.environ)
+  if workers is not None:
+    env['CILK_NWORKERS'] = str(workers)
+  env.update(extra_env or {})
+  command = [binary, '-b', broadphase, str(frames), scene]
+  return subprocess.run(command, check=True, stdout=subprocess.PIPE,
+                        universal_newlines=True, env=env).stdout
+
+
+def timed_run(args, broadphase, scene, frames, workers):
+  """Run a scene --repeat times with the given workers and summarize it."""
+  runs = []
+  for _ in range(args.repeat):
+    output = run(args.binary, broadphase, scene, frames, workers)
+    result = {}
+    for key, pattern in RESULT_PATTERNS.items():
+      match = pattern.search(output)
+      if match is None:
+        sys.exit('%s: no "%s" in the output of %s' % (scene, key,
+                                                      args.binary))
+      result[key] = float(match.group(1))
+    runs.append(result)
+  return {
+      'elapsed': statistics.median(r['elapsed'] for r in runs),
+      'counts': {(int(r['wall']), int(r['line'])) for r in runs},
+  }
+
+
+def cilkscale(args, scene):
+  """Measure the work, span and parallelism of one scene."""
+  with tempfile.TemporaryDirectory() as tmp:
+    out = os.path.join(tmp, 'cilkscale.csv')
+    run(args.cilkscale_binary, args.broadphase, scene, args.frames,
+        extra_env={'CILKSCALE_OUT': out})
+    with open(out) as f:
+      rows = list(csv.reader(f))
+  # The header names each column with its unit, as in "work (seconds)".  The
+  # last row covers the whole program.
+  header = [name.split(' ')[0] for name in rows[0]]
+  total = dict(zip(header, rows[-1]))
+  return {key: float(total[key]) for key in
+          ('work', 'span', 'parallelism', 'burdened_parallelism')
+          if key in total}
+
+
+def scale(results, weak=False):
+  """Add the speedup and efficiency over one worker to every result.
+
+  In weak scaling each run has as many times the work of the first as it has
+  workers, so the speedup is scaled by that.
+  """
+  serial = results[0]['elapsed']
+  for r in results:
+    ratio = serial / r['elapsed'] if r['elapsed'] else 0.0
+    r['speedup'] = ratio * r['workers'] if weak else ratio
+    r['efficiency'] = r['speedup'] / r['workers']
+
+
+def strong_scaling(args, workers):
+  table = []
+  ok = True
+  for scene in sorted(glob.glob(args.scenes)):
+    name = os.path.splitext(os.path.basename(scene))[0]
+    runs = [timed_run(args, args.broadphase, scene, args.frames, w)
+            for w in workers]
+    counts = set().union(*(r['counts'] for r in runs))
+    if len(counts) != 1:
+      print('%s: counts depend on the number of workers: %s' %
+            (name, sorted(counts)), file=sys.stderr)
+      ok = False
+    results = [{'scene': name, 'workers': w, 'elapsed': r['elapsed']}
+               for r, w in zip(runs, workers)]
+    scale(results)
+    table.extend(results)
+  return table, ok
+
+
+def parallelism(args):
+  return [dict(scene=os.path.splitext(os.path.basename(scene))[0],
+               **cilkscale(args, scene))
+          for scene in sorted(glob.glob(args.scenes))]
+
+
+def weak_scaling(args, workers):
+  table = []
+  with tempfile.TemporaryDirectory() as tmp:
+    for w in workers:
+      scene = os.path.join(tmp, 'weak%d.bin' % w)
+      subprocess.run([args.scene_gen, '-d', args.weak_distribution, '-n',
+                      str(w * args.weak_lines), scene], check=True,
+                     stdout=subprocess.DEVNULL)
+      elapsed = timed_run(args, args.weak_broadphase, scene,
+                          args.weak_frames, w)['elapsed']
+      table.append({'scene': 'weak', 'workers': w,
+                    'lines': w * args.weak_lines, 'elapsed': elapsed})
+  scale(table, weak=True)
+  return table
+
+
+def print_table(title, table):
+  print(title)
+  columns = []
+  for r in table:
+    columns.extend(k for k in r if k not in columns)
+  print(' '.join('%12s' % c[:12] for c in columns))
+  for r in table:
+    cells = []
+    for c in columns:
+      v = r.get(c, '')
+      cells.append('%12.4g' % v if isinstance(v, float) else '%12s' % v)
+    print(' '.join(cells))
+  print()
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+  parser.add_argument('--binary', default='./screensaver.double',
+                      help='text-only simulator to time')
+  parser.add_argument('--cilkscale-binary',
+                      help='the simulator built with Cilkscale, if any')
+  parser.add_argument('--scene-gen', default='./scene_gen',
+                      help='generator of the weak scaling scenes')
+  parser.add_argument('--workers', type=int, default=os.cpu_count(),
+                      help='largest number of workers to run with')
+  parser.add_argument('--frames', type=int, default=300)
+  parser.add_argument('--repeat', type=int, default=3)
+  parser.add_argument('--broadphase', default='quadtree')
+  parser.add_argument('--scenes', default='input/*.in',
+                      help='glob of the strong scaling scenes')
+  parser.add_argument('--weak-lines', type=int, default=10000,
+                      help='lines per worker of the weak scaling scenes, '
+                      'or 0 to skip weak scaling')
+  parser.add_argument('--weak-frames', type=int, default=100)
+  parser.add_argument('--weak-broadphase', default='grid',
+                      help='broad phase of the weak scaling runs, which '
+                      'should do work in proportion to the lines')
+  parser.add_argument('--weak-distribution', default='random')
+  parser.add_argument('--min-efficiency', type=float, default=0.0,
+                      help='fail if the efficiency at the largest worker '
+                      'count is lower than this')
+  parser.add_argument('--json', help='also write the results to this file')
+  parser.add_argument('--csv', help='also write the results to this file')
+  args = parser.parse_args()
+  if args.repeat < 1 or args.workers < 1:
+    parser.error('--repeat and --workers must be positive')
+
+  workers = list(range(1, args.workers + 1))
+  spans = []
+  if args.cilkscale_binary:
+    spans = parallelism(args)
+    print_table('Work and span in seconds, and parallelism', spans)
+  strong, ok = strong_scaling(args, workers)
+  print_table('Strong scaling', strong)
+  weak = []
+  if args.weak_lines > 0:
+    weak = weak_scaling(args, workers)
+    print_table('Weak scaling, %d lines per worker' % args.weak_lines, weak)
+
+  for r in strong + weak:
+    if r['workers'] == args.workers and r['efficiency'] < args.min_efficiency:
+      print('%s: efficiency %.2f on %d workers is below %.2f' %
+            (r['scene'], r['efficiency'], r['workers'], args.min_efficiency),
+            file=sys.stderr)
+      ok = False
+
+  if args.json:
+    with open(args.json, 'w') as f:
+      json.dump({'binary': args.binary, 'frames': args.frames,
+                 'repeat': args.repeat, 'broadphase': args.broadphase,
+                 'parallelism': spans, 'strong': strong, 'weak': weak},
+                f, indent=2)
+      f.write('\n')
+  if args.csv:
+    rows = spans + strong + weak
+    fields = []
+    for r in rows:
+      fields.extend(k for k in r if k not in fields)
+    with open(args.csv, 'w', newline='') as f:
+      writer = csv.DictWriter(f, fieldnames=fields)
+      writer.writeheader()
+      writer.writerows(rows)
+
+  return 0 if ok else 1
+
+
+if __name__ == '__main__':
+  sys.exit(main())
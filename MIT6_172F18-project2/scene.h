@@ -0,0 +1,55 @@
+/**
+ * scene.h -- binary scene file format
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include <stdint.h>
+
+// A binary scene holds the same information as a text scene: a header
+// followed by one record per line, in window coordinates and window velocity
+// units, in the byte order of the machine that wrote it.  Fixed-size records
+// let a loader map the file and convert every line independently.
+
+#define SCENE_MAGIC "LSCN"
+#define SCENE_VERSION 1
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t numOfLines;
+  uint32_t reserved;
+} SceneHeader;
+
+typedef struct {
+  double p1x, p1y;
+  double p2x, p2y;
+  double vx, vy;
+  uint32_t isGray;
+  uint32_t reserved;
+} SceneRecord;
+
+_Static_assert(sizeof(SceneHeader) == 16, "SceneHeader must be packed");
+_Static_assert(sizeof(SceneRecord) == 56, "SceneRecord must be packed");
+
+#endif  // SCENE_H_
@@ -0,0 +1,299 @@
+/**
+ * scene_gen.c -- generate large input scenes
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./line.h"
+#include "./scene.h"
+
+typedef enum {
+  DIST_RANDOM,    // uniformly scattered lines moving in random directions
+  DIST_CLUSTER,   // lines gathered around a few centers
+  DIST_EXPLOSION, // lines packed near the middle, moving outwards
+  DIST_LATTICE    // lines on a regular grid, alternating in orientation
+} Distribution;
+
+static const char *distributionNames[] = {
+    [DIST_RANDOM] = "random",
+    [DIST_CLUSTER] = "cluster",
+    [DIST_EXPLOSION] = "explosion",
+    [DIST_LATTICE] = "lattice",
+};
+
+typedef struct {
+  Distribution distribution;
+  uint32_t numOfLines;
+  // Fraction of the window's width and height that the lines start in.
+  double spread;
+  // Line length as a multiple of the spacing of numOfLines evenly spread
+  // lines.
+  double length;
+  // Largest speed, in window units per time step.  Negative to derive it
+  // from the line length.
+  double speed;
+  uint32_t clusters;
+  uint64_t seed;
+} SceneParams;
+
+// splitmix64, so that a seed gives the same scene on every platform.
+static uint64_t next_random(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Uniform in [lo, hi).
+static double uniform(uint64_t *state, double lo, double hi) {
+  return lo + (hi - lo) * (next_random(state) >> 11) * 0x1.0p-53;
+}
+
+// Standard normal, by the Box-Muller transform.
+static double normal(uint64_t *state) {
+  double u = uniform(state, 0x1.0p-53, 1);
+  double v = uniform(state, 0, 2 * M_PI);
+  return sqrt(-2 * log(u)) * cos(v);
+}
+
+static double clamp(double x, double lo, double hi) {
+  return x < lo ? lo : x > hi ? hi : x;
+}
+
+static void generate(const SceneParams *params, SceneRecord *records) {
+  uint64_t state = params->seed;
+  double w = WINDOW_WIDTH * params->spread;
+  double h = WINDOW_HEIGHT * params->spread;
+  double x0 = (WINDOW_WIDTH - w) / 2;
+  double y0 = (WINDOW_HEIGHT - h) / 2;
+  double spacing = sqrt(w * h / params->numOfLines);
+  double length = params->length * spacing;
+  double speed = params->speed >= 0 ? params->speed : length;
+  // Keep every endpoint strictly inside the window.
+  double margin = length / 2 + 1;
+
+  double *cx = NULL;
+  double *cy = NULL;
+  if (params->distribution == DIST_CLUSTER) {
+    cx = malloc(params->clusters * sizeof(double));
+    cy = malloc(params->clusters * sizeof(double));
+    for (uint32_t k = 0; k < params->clusters; k++) {
+      cx[k] = uniform(&state, x0, x0 + w);
+      cy[k] = uniform(&state, y0, y0 + h);
+    }
+  }
+  uint32_t columns = (uint32_t)ceil(sqrt(params->numOfLines * w / h));
+
+  for (uint32_t i = 0; i < params->numOfLines; i++) {
+    double x = 0, y = 0, angle, vx, vy;
+    angle = uniform(&state, 0, 2 * M_PI);
+    vx = uniform(&state, -speed, speed);
+    vy = uniform(&state, -speed, speed);
+    switch (params->distribution) {
+    case DIST_RANDOM:
+      x = uniform(&state, x0, x0 + w);
+      y = uniform(&state, y0, y0 + h);
+      break;
+    case DIST_CLUSTER: {
+      uint32_t k = next_random(&state) % params->clusters;
+      double sigma = sqrt(w * h / params->clusters) / 4;
+      x = cx[k] + sigma * normal(&state);
+      y = cy[k] + sigma * normal(&state);
+      break;
+    }
+    case DIST_EXPLOSION: {
+      double r = sqrt(uniform(&state, 0, 1)) * fmin(w, h) / 2;
+      double theta = uniform(&state, 0, 2 * M_PI);
+      double s = uniform(&state, 0, speed);
+      x = WINDOW_WIDTH / 2.0 + r * cos(theta);
+      y = WINDOW_HEIGHT / 2.0 + r * sin(theta);
+      vx = s * cos(theta);
+      vy = s * sin(theta);
+      break;
+    }
+    case DIST_LATTICE:
+      x = x0 + (i % columns + 0.5) * w / columns;
+      y = y0 + (i / columns + 0.5) * spacing;
+      angle = (i % 2) ? M_PI / 4 : -M_PI / 4;
+      break;
+    }
+    x = clamp(x, margin, WINDOW_WIDTH - margin);
+    y = clamp(y, margin, WINDOW_HEIGHT - margin);
+    double dx = length / 2 * cos(angle);
+    double dy = length / 2 * sin(angle);
+    records[i] = (SceneRecord){.p1x = x - dx,
+                               .p1y = y - dy,
+                               .p2x = x + dx,
+                               .p2y = y + dy,
+                               .vx = vx,
+                               .vy = vy,
+                               .isGray = i % 2,
+                               .reserved = 0};
+  }
+  free(cx);
+  free(cy);
+}
+
+// Read a text scene, so that it can be converted to a binary one.
+static SceneRecord *read_text(const char *path, uint32_t *numOfLines) {
+  FILE *fin = fopen(path, "r");
+  if (fin == NULL || fscanf(fin, "%u\n", numOfLines) != 1) {
+    fprintf(stderr, "Cannot read scene (%s)\n", path);
+    exit(1);
+  }
+  SceneRecord *records = calloc(*numOfLines, sizeof(SceneRecord));
+  int isGray;
+  for (uint32_t i = 0; i < *numOfLines; i++) {
+    SceneRecord *r = &records[i];
+    if (fscanf(fin, "(%lf, %lf), (%lf, %lf), %lf, %lf, %d\n", &r->p1x,
+               &r->p1y, &r->p2x, &r->p2y, &r->vx, &r->vy, &isGray) != 7) {
+      fprintf(stderr, "Scene %s ends after %u lines\n", path, i);
+      exit(1);
+    }
+    r->isGray = isGray;
+  }
+  fclose(fin);
+  return records;
+}
+
+static void write_binary(FILE *out, const SceneRecord *records,
+                         uint32_t numOfLines) {
+  SceneHeader header = {.version = SCENE_VERSION, .numOfLines = numOfLines};
+  memcpy(header.magic, SCENE_MAGIC, sizeof(header.magic));
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(records, sizeof(SceneRecord), numOfLines, out);
+}
+
+static void write_text(FILE *out, const SceneRecord *records,
+                       uint32_t numOfLines) {
+  fprintf(out, "%u\n", numOfLines);
+  for (uint32_t i = 0; i < numOfLines; i++) {
+    const SceneRecord *r = &records[i];
+    fprintf(out, "(%f, %f), (%f, %f), %f, %f, %u\n", r->p1x, r->p1y, r->p2x,
+            r->p2y, r->vx, r->vy, r->isGray);
+  }
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [options] <outputfile>\n", name);
+  printf("  -d : distribution: random (default), cluster, explosion or "
+         "lattice\n");
+  printf("  -n : number of lines (default 100000)\n");
+  printf("  -r : fraction of the window the lines start in (default 1)\n");
+  printf("  -l : line length, relative to the spacing of evenly spread lines\n"
+         "       (default 0.5)\n");
+  printf("  -v : largest speed in window units per time step (default: the\n"
+         "       line length)\n");
+  printf("  -k : number of clusters (default 16)\n");
+  printf("  -s : random seed (default 1)\n");
+  printf("  -i : convert this text scene instead of generating one\n");
+  printf("  -t : write a text scene instead of a binary one\n");
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  SceneParams params = {.distribution = DIST_RANDOM,
+                        .numOfLines = 100000,
+                        .spread = 1,
+                        .length = 0.5,
+                        .speed = -1,
+                        .clusters = 16,
+                        .seed = 1};
+  const char *input = NULL;
+  bool text = false;
+  int optchar;
+  while ((optchar = getopt(argc, argv, "d:n:r:l:v:k:s:i:t")) != -1) {
+    switch (optchar) {
+    case 'd': {
+      int d = 0;
+      while (d <= DIST_LATTICE && strcmp(optarg, distributionNames[d]) != 0) {
+        d++;
+      }
+      if (d > DIST_LATTICE) {
+        printf("Unknown distribution: %s\n", optarg);
+        exit(-1);
+      }
+      params.distribution = (Distribution)d;
+      break;
+    }
+    case 'n':
+      params.numOfLines = strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      params.spread = atof(optarg);
+      break;
+    case 'l':
+      params.length = atof(optarg);
+      break;
+    case 'v':
+      params.speed = atof(optarg);
+      break;
+    case 'k':
+      params.clusters = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      params.seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'i':
+      input = optarg;
+      break;
+    case 't':
+      text = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || params.numOfLines == 0 || params.clusters == 0 ||
+      params.spread <= 0 || params.spread > 1 || params.length <= 0) {
+    usage(argv[0]);
+  }
+
+  uint32_t numOfLines = params.numOfLines;
+  SceneRecord *records;
+  if (input != NULL) {
+    records = read_text(input, &numOfLines);
+  } else {
+    records = malloc(numOfLines * sizeof(SceneRecord));
+    generate(&params, records);
+  }
+
+  FILE *out = fopen(argv[optind], "wb");
+  if (out == NULL) {
+    fprintf(stderr, "Cannot write %s\n", argv[optind]);
+    exit(1);
+  }
+  if (text) {
+    write_text(out, records, numOfLines);
+  } else {
+    write_binary(out, records, numOfLines);
+  }
+  fclose(out);
+  free(records);
+  return 0;
+}
@@ -21,14 +21,16 @@
  **/
 
 #include <cilk/cilk.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
-#include "./cilktool.h"
+#include "./bvh.h"
 #include "./fasttime.h"
 #include "./line.h"
 #include "./line_demo.h"
+#include "./pair_cache.h"
 
 // The PROFILE_BUILD preprocessor define is used to indicate we are building for
 // profiling, so don't include any graphics or Cilk functions.
@@ -37,6 +39,7 @@
 #endif
 static char *DEFAULT_INPUT_FILE_PATH = "input/mit.in";
 static char *input_file_path;
+static bool verbose = false;
 
 // For non-graphic version
 void lineMain(LineDemo *lineDemo) {
@@ -47,6 +50,14 @@ void lineMain(LineDemo *lineDemo) {
       break;
     }
   }
+  QuadTreeStats *stats = &gQuadTree.stats;
+  if (verbose && stats->updates > 0) {
+    printf("Quadtree per frame: %.1f lines moved, %.2f splits, %.2f merges\n",
+           (double)stats->linesMoved / stats->updates,
+           (double)stats->splits / stats->updates,
+           (double)stats->merges / stats->updates);
+  }
+  delete_quadtree(&gQuadTree);
 }
 
 int main(int argc, char *argv[]) {
@@ -55,14 +66,72 @@ int main(int argc, char *argv[]) {
   bool graphicDemoFlag = false;
 #endif
   unsigned int numFrames = 1;
+  BroadPhase broadPhase = BROAD_PHASE_QUADTREE;
+  int grainSize = DEFAULT_GRAIN_SIZE;
+  long long spawnCutoff = DEFAULT_SPAWN_CUTOFF;
+  char *checkpointPath = NULL;
+  int checkpointInterval = 0;
+  extern char *optarg;
   extern int optind;
 
   // Process command line options.
-  while ((optchar = getopt(argc, argv, "gi")) != -1) {
+  while ((optchar = getopt(argc, argv, "gib:c:w:vs:r:R:q:k:K:")) != -1) {
     switch (optchar) {
     case 'g':
 #ifndef PROFILE_BUILD
       graphicDemoFlag = true;
+#endif
+      break;
+    case 'b':
+      if (!BroadPhase_parse(optarg, &broadPhase)) {
+        printf("Unknown broad phase: %s\n", optarg);
+        exit(-1);
+      }
+      break;
+    case 'c':
+      grainSize = atoi(optarg);
+      if (grainSize <= 0) {
+        printf("Grain size must be positive: %s\n", optarg);
+        exit(-1);
+      }
+      break;
+    case 'w':
+      spawnCutoff = atoll(optarg);
+      if (spawnCutoff < 0) {
+        printf("Spawn cutoff must not be negative: %s\n", optarg);
+        exit(-1);
+      }
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'r':
+    case 'R':
+      LineDemo_setRecordFile(optarg, optchar == 'R');
+      break;
+    case 'q':
+      if (atoi(optarg) <= 0) {
+        printf("Number of queued frames must be positive: %s\n", optarg);
+        exit(-1);
+      }
+      LineDemo_setRecordSlots(atoi(optarg));
+      break;
+    case 'k':
+      checkpointPath = optarg;
+      break;
+    case 'K':
+      checkpointInterval = atoi(optarg);
+      if (checkpointInterval <= 0) {
+        printf("Checkpoint interval must be positive: %s\n", optarg);
+        exit(-1);
+      }
+      break;
+    case 's':
+#ifdef COLLISION_STATS
+      LineDemo_setStatsDumpFile(optarg);
+#else
+      printf("Per-frame stats need a build with STATS=1\n");
+      exit(-1);
 #endif
       break;
     default:
@@ -79,8 +148,31 @@ int main(int argc, char *argv[]) {
 
   // Check to make sure number of arguments is correct.
   if (remaining_args < 1) {
-    printf("Usage: %s [-g] <numFrames> [inputfile]\n", argv[0]);
+    printf("Usage: %s [-g] [-v] [-b broadphase] [-c grainsize] [-w pairs] "
+           "[-s file] [-r|-R file] [-k file [-K frames]] <numFrames> "
+           "[inputfile]\n",
+           argv[0]);
     printf("  -g : show graphics\n");
+    printf("  -v : print phase times, quadtree statistics and a hash of the\n"
+           "       final line velocities\n");
+    printf("  -b : broad phase: brute, quadtree (default), grid, sap,\n"
+           "       morton, bvh or verlet\n");
+    printf("  -c : lines per parallel chunk of the position and wall\n"
+           "       updates (default %d)\n",
+           DEFAULT_GRAIN_SIZE);
+    printf("  -w : pairs a quadtree subtree must test to be traversed in\n"
+           "       parallel (default %d)\n",
+           DEFAULT_SPAWN_CUTOFF);
+    printf("  -s : write pipeline counters for every frame to file as CSV\n"
+           "       (builds with STATS=1 only)\n");
+    printf("  -r : record every frame to file, for ./replay\n");
+    printf("  -R : record every frame to file, delta-encoded\n");
+    printf("  -q : frames the recorder can queue for its writer before it\n"
+           "       drops them (default %d)\n",
+           RECORDER_DEFAULT_SLOTS);
+    printf("  -k : write a checkpoint to file at the end of the run; give\n"
+           "       it as inputfile to carry on up to numFrames\n");
+    printf("  -K : also write the checkpoint every that many frames\n");
     exit(-1);
   }
 
@@ -93,12 +185,23 @@ int main(int argc, char *argv[]) {
     input_file_path = DEFAULT_INPUT_FILE_PATH;
   }
   printf("Input file path is: %s\n", input_file_path);
+  printf("Broad phase is: %s\n", BroadPhase_name(broadPhase));
 
   // Create and initialize the Line simulation environment.
   LineDemo *lineDemo = LineDemo_new();
   LineDemo_setInputFile(input_file_path);
+  LineDemo_setBroadPhase(broadPhase);
+  LineDemo_setGrainSize(grainSize);
+  LineDemo_setSpawnCutoff(spawnCutoff);
+  if (checkpointPath != NULL) {
+    LineDemo_setCheckpointFile(checkpointPath, checkpointInterval);
+  } else if (checkpointInterval > 0) {
+    printf("-K needs a checkpoint file given with -k\n");
+    exit(-1);
+  }
   LineDemo_initLine(lineDemo);
   LineDemo_setNumFrames(lineDemo, numFrames);
+  printf("Number of lines = %u\n", LineDemo_getNumOfLines(lineDemo));
 
   const fasttime_t start_time = gettime();
 
@@ -114,6 +217,8 @@ int main(int argc, char *argv[]) {
 #endif
 
   const fasttime_t end_time = gettime();
+  bool recorded =
+      lineDemo->recorder == NULL || Recorder_finish(lineDemo->recorder);
 
   // Output results.
   printf("---- RESULTS ----\n");
@@ -122,13 +227,43 @@ int main(int argc, char *argv[]) {
          LineDemo_getNumLineWallCollisions(lineDemo));
   printf("%u Line-Line Collisions\n",
          LineDemo_getNumLineLineCollisions(lineDemo));
+  if (verbose) {
+    PhaseTimes times = LineDemo_getPhaseTimes(lineDemo);
+    printf("Phase times: broad %fs, narrow %fs, sort %fs, solve %fs, "
+           "update %fs\n",
+           times.broadPhase, times.narrowPhase, times.sort, times.solve,
+           times.update);
+    printf("Velocity hash: %016" PRIx64 "\n",
+           LineDemo_getVelocityHash(lineDemo));
+    if (lineDemo->collisionWorld->bvh != NULL) {
+      printf("BVH rebuilt %zu times\n",
+             lineDemo->collisionWorld->bvh->rebuilds);
+    }
+    PairCache *cache = lineDemo->collisionWorld->pairCache;
+    if (cache != NULL) {
+      printf("Pair cache: rebuilt %zu times, reused for %zu frames, "
+             "%zu pairs cached\n",
+             cache->rebuilds, cache->framesReused,
+             cache->start[cache->numOfLines]);
+    }
+    if (lineDemo->recorder != NULL) {
+      printf("Recorder dropped %zu frames the writer could not keep up "
+             "with\n",
+             lineDemo->recorder->dropped);
+      if (recorded) {
+        printf("Recorded %zu frames\n", lineDemo->recorder->framesWritten);
+      } else {
+        printf("Recording failed, the file is incomplete\n");
+      }
+    }
+  }
+#ifdef COLLISION_STATS
+  LineDemo_printStats(lineDemo);
+#endif
   printf("---- END RESULTS ----\n");
 
   // delete objects
   LineDemo_delete(lineDemo);
-#ifdef CILKSCALE
-  print_total();
-#endif
 
-  return 0;
+  return recorded ? 0 : 1;
 }
@@ -0,0 +1,106 @@
+/**
+ * simd.h -- thin wrappers over the vector instructions used by the kernels
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+#define HAVE_SIMD
+
+#include "./vec.h"
+
+#ifdef VEC_FLOAT
+// Number of vec_dimension values held by one vector register.
+#define VLANES 8
+
+// A vector of vec_dimension values.  Comparisons produce masks of the same
+// type, with all bits of a lane set where the comparison holds.
+typedef __m256 vreal;
+
+static inline vreal vload(const vec_dimension *p) { return _mm256_load_ps(p); }
+static inline vreal vset1(vec_dimension x) { return _mm256_set1_ps(x); }
+static inline vreal vadd(vreal a, vreal b) { return _mm256_add_ps(a, b); }
+static inline vreal vsub(vreal a, vreal b) { return _mm256_sub_ps(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm256_mul_ps(a, b); }
+static inline vreal vand(vreal a, vreal b) { return _mm256_and_ps(a, b); }
+static inline vreal vor(vreal a, vreal b) { return _mm256_or_ps(a, b); }
+
+// Ordered, non-signalling comparisons, matching the C operators on NaN.
+static inline vreal vgt(vreal a, vreal b) {
+  return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+}
+static inline vreal vlt(vreal a, vreal b) {
+  return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+static inline vreal vle(vreal a, vreal b) {
+  return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+}
+static inline vreal veq(vreal a, vreal b) {
+  return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);
+}
+
+// Returns a bitmask with bit i set if lane i of the mask is set.
+static inline unsigned int vmovemask(vreal mask) {
+  return _mm256_movemask_ps(mask);
+}
+#else
+// Number of vec_dimension values held by one vector register.
+#define VLANES 4
+
+// A vector of vec_dimension values.  Comparisons produce masks of the same
+// type, with all bits of a lane set where the comparison holds.
+typedef __m256d vreal;
+
+static inline vreal vload(const vec_dimension *p) { return _mm256_load_pd(p); }
+static inline vreal vset1(vec_dimension x) { return _mm256_set1_pd(x); }
+static inline vreal vadd(vreal a, vreal b) { return _mm256_add_pd(a, b); }
+static inline vreal vsub(vreal a, vreal b) { return _mm256_sub_pd(a, b); }
+static inline vreal vmul(vreal a, vreal b) { return _mm256_mul_pd(a, b); }
+static inline vreal vand(vreal a, vreal b) { return _mm256_and_pd(a, b); }
+static inline vreal vor(vreal a, vreal b) { return _mm256_or_pd(a, b); }
+
+// Ordered, non-signalling comparisons, matching the C operators on NaN.
+static inline vreal vgt(vreal a, vreal b) {
+  return _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+}
+static inline vreal vlt(vreal a, vreal b) {
+  return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+}
+static inline vreal vle(vreal a, vreal b) {
+  return _mm256_cmp_pd(a, b, _CMP_LE_OQ);
+}
+static inline vreal veq(vreal a, vreal b) {
+  return _mm256_cmp_pd(a, b, _CMP_EQ_OQ);
+}
+
+// Returns a bitmask with bit i set if lane i of the mask is set.
+static inline unsigned int vmovemask(vreal mask) {
+  return _mm256_movemask_pd(mask);
+}
+#endif  // VEC_FLOAT
+
+#endif  // __AVX2__
+
+#endif  // SIMD_H_
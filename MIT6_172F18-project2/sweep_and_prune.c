@@ -0,0 +1,88 @@
+/**
+ * sweep_and_prune.c -- lines kept sorted along x by their swept bounds
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./sweep_and_prune.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+static inline void set_bounds(SapEntry *e, double t) {
+  Line_sweptBounds(e->line, t, &e->xlo, &e->ylo, &e->xhi, &e->yhi);
+}
+
+static int compare_entries(const void *a, const void *b) {
+  double x = ((const SapEntry *)a)->xlo;
+  double y = ((const SapEntry *)b)->xlo;
+  return (x > y) - (x < y);
+}
+
+SweepAndPrune *SweepAndPrune_new(CollisionWorld *collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  SweepAndPrune *sap = malloc(sizeof(SweepAndPrune));
+  assert(sap);
+  sap->entries = malloc(sizeof(SapEntry) * (n > 0 ? n : 1));
+  assert(sap->entries);
+  sap->numOfEntries = n;
+
+  // The initial order has no coherence to exploit, so sort it outright.
+  for (unsigned int i = 0; i < n; i++) {
+    sap->entries[i].line = collisionWorld->lines[i];
+    set_bounds(&sap->entries[i], collisionWorld->timeStep);
+  }
+  qsort(sap->entries, n, sizeof(SapEntry), compare_entries);
+  return sap;
+}
+
+void SweepAndPrune_delete(SweepAndPrune *sap) {
+  if (sap == NULL) {
+    return;
+  }
+  free(sap->entries);
+  free(sap);
+}
+
+void SweepAndPrune_update(SweepAndPrune *sap, CollisionWorld *collisionWorld) {
+  SapEntry *entries = sap->entries;
+  unsigned int n = sap->numOfEntries;
+  double t = collisionWorld->timeStep;
+
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    set_bounds(&entries[i], t);
+  }
+
+  // Insertion sort on xlo.  Each line has moved by at most one time step since
+  // the last sort, so only a few entries are out of place and this is close to
+  // a single linear pass.
+  for (unsigned int i = 1; i < n; i++) {
+    if (entries[i - 1].xlo <= entries[i].xlo) {
+      continue;
+    }
+    SapEntry e = entries[i];
+    unsigned int j = i;
+    do {
+      entries[j] = entries[j - 1];
+      j--;
+    } while (j > 0 && entries[j - 1].xlo > e.xlo);
+    entries[j] = e;
+  }
+}
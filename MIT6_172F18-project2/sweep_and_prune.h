@@ -0,0 +1,56 @@
+/**
+ * sweep_and_prune.h -- lines kept sorted along x by their swept bounds
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef SWEEP_AND_PRUNE_H_
+#define SWEEP_AND_PRUNE_H_
+
+#include "./collision_world.h"
+#include "./line.h"
+
+// A line's swept bounding box for the coming time step.
+typedef struct {
+  double xlo;
+  double xhi;
+  double ylo;
+  double yhi;
+  Line *line;
+} SapEntry;
+
+// The lines' swept bounding boxes, sorted by their lower x bound.  Lines move
+// only a little per time step, so the order from the previous frame is nearly
+// sorted and is repaired with an insertion sort.
+struct SweepAndPrune {
+  SapEntry *entries;
+  unsigned int numOfEntries;
+};
+typedef struct SweepAndPrune SweepAndPrune;
+
+// Create the sorted list for the lines currently in the world.
+SweepAndPrune *SweepAndPrune_new(CollisionWorld *collisionWorld);
+
+void SweepAndPrune_delete(SweepAndPrune *sap);
+
+// Refresh every line's bounds for the coming time step and restore the order.
+void SweepAndPrune_update(SweepAndPrune *sap, CollisionWorld *collisionWorld);
+
+#endif  // SWEEP_AND_PRUNE_H_
@@ -26,7 +26,13 @@
 
 #include <stdbool.h>
 
+// Coordinates are double precision unless VEC_FLOAT is defined ("make
+// FLOAT=1"), which halves their size and doubles the SIMD lanes.
+#ifdef VEC_FLOAT
+typedef float vec_dimension;
+#else
 typedef double vec_dimension;
+#endif
 
 // Forward definition of Line to avoid needing to circularly include Line.h
 struct Line;